@@ -0,0 +1,18 @@
+#include <Arduino.h>
+#include <SmoothStepperBenchmark.h>
+
+//Step timing benchmarks on the board, prints CSV on the serial port.
+
+static void output(const char *line) { Serial.println(line); }
+
+SmoothStepperBenchmark benchmark(stepperDefaultClock(), output);
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    benchmark.runAll(16);
+}
+
+void loop() {
+}
@@ -0,0 +1,43 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+#include <SmoothStepperCoordinator.h>
+
+const int stepsPerRevolution = 2048;
+
+SmoothStepper axisX(stepsPerRevolution, 23, 22, 21, 19);
+SmoothStepper axisY(stepsPerRevolution, 18, 5, 17, 16);
+SmoothStepper axisZ(stepsPerRevolution, 4, 0, 2, 15);
+SmoothStepperCoordinator axes;
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!axes.accelerationEnable(3, 15, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //The axes are stepped by the coordinator, don't call their begin().
+    axes.add(&axisX);
+    axes.add(&axisY);
+    axes.add(&axisZ);
+    axes.begin();
+}
+
+void loop() {
+    long target[3] = {random(-1000, 1000), random(-1000, 1000), random(-200, 200)};
+
+    //The three axes start and arrive together, along a straight line.
+    axes.moveTo(target);
+    axes.waitUntilArrived();
+
+    Serial.print("Arrived at ");
+    Serial.print(axisX.whatStepNumber());
+    Serial.print(" ");
+    Serial.print(axisY.whatStepNumber());
+    Serial.print(" ");
+    Serial.println(axisZ.whatStepNumber());
+    delay(500);
+}
@@ -0,0 +1,65 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+#include <SmoothStepperCoordinator.h>
+#include <SmoothStepperGcode.h>
+
+#include <string.h>
+
+const int stepsPerRevolution = 2048;
+
+SmoothStepper axisX(stepsPerRevolution, 23, 22, 21, 19);
+SmoothStepper axisY(stepsPerRevolution, 18, 5, 17, 16);
+SmoothStepperCoordinator axes;
+SmoothStepperGcode gcode(&axes);
+
+//Could come from Serial or a file on a SD card, in chunks of any size.
+const char program[] =
+    "G21 G90 ; mm, absolute\n"
+    "M17\n"
+    "G0 X10 Y10\n"
+    "G1 X30 F300\n"
+    "G1 Y30\n"
+    "G1 X10 Y10 F450\n"
+    "G4 P250\n"
+    "G28\n"
+    "M18 ; coils released\n";
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    //40 mm per revolution, speeds in mm/min on the path.
+    if (!gcode.setStepsPerUnit(stepsPerRevolution / 40.0) || !gcode.accelerationEnable(120, 600, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //The axes are stepped by the coordinator, don't call their begin().
+    axes.add(&axisX);
+    axes.add(&axisY);
+    axes.begin();
+}
+
+void loop() {
+    size_t length = strlen(program);
+    size_t written = 0;
+    while (written < length) {
+        size_t chunk = length - written < 32 ? length - written : 32;
+        size_t consumed = gcode.write(reinterpret_cast<const uint8_t *>(program) + written, chunk);
+        written += consumed;
+        if (consumed < chunk) {
+            delay(10);  //The move queue is full: the axes are busy, parse the rest later.
+        }
+    }
+    while (!gcode.isIdle()) {
+        gcode.write(nullptr, 0);  //The last line may still wait for room
+        delay(10);
+    }
+
+    Serial.print("Program done, lines: ");
+    Serial.print(gcode.lines());
+    Serial.print(", errors: ");
+    Serial.println(gcode.errors());
+    delay(500);
+}
@@ -0,0 +1,43 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+#include <SmoothStepperGroup.h>
+
+const int stepsPerRevolution = 2048;
+
+SmoothStepper smoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+SmoothStepper smoothStepper2(stepsPerRevolution, 18, 5, 17, 16);
+SmoothStepperGroup group;
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!smoothStepper.accelerationEnable(3, 15, 500) ||
+        !smoothStepper2.accelerationEnable(3, 15, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //Both motors are serviced by the same task, don't call their begin().
+    group.add(&smoothStepper);
+    group.add(&smoothStepper2);
+    group.begin();
+}
+
+void loop() {
+    int a = random(-600, 600);
+
+    smoothStepper.step(a);
+    smoothStepper2.step(-a);
+
+    //Block until both motors are arrived, without using the CPU.
+    if (!group.waitAll(3000)) {
+        Serial.println("Not arrived after 3s");
+    }
+
+    Serial.print("Deadline misses stepper 1: ");
+    Serial.print(group.deadlineMisses(0));
+    Serial.print("  || stepper 2: ");
+    Serial.println(group.deadlineMisses(1));
+}
@@ -0,0 +1,39 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 2048;  // 28BYJ-48, full steps
+
+//Half steps: 4096 steps per revolution, the coils change half as much per step.
+SmoothStepperMotor<4, FourWireHalfSequence> myStepper(stepsPerRevolution, 23, 22, 21, 19);
+
+//Any phase table: here the wave drive, one coil at a time.
+const int wavePins[] = {18, 5, 17, 16};
+const uint8_t wavePhases[] = {0b1000, 0b0010, 0b0100, 0b0001};
+SmoothStepper waveStepper(stepsPerRevolution, wavePins, 4, wavePhases, 4);
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!myStepper.accelerationEnable(3, 15, 500) || !waveStepper.accelerationEnable(3, 10, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+    myStepper.begin();
+    waveStepper.begin();
+}
+
+void loop() {
+    //One revolution each, the speeds stay in rev/min.
+    myStepper.step(4096);
+    waveStepper.step(2048);
+    myStepper.waitUntilArrived();
+    waveStepper.waitUntilArrived();
+
+    Serial.print("Rotations ");
+    Serial.print(myStepper.whatRotationNumber());
+    Serial.print(" ");
+    Serial.println(waveStepper.whatRotationNumber());
+    delay(500);
+}
@@ -0,0 +1,35 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 2048;  // change this to fit the number of steps per revolution for your motor
+
+//Conveyor: runs without a target, its speed follows the line.
+SmoothStepper myStepper(stepsPerRevolution, 23, 22, 21, 19);
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!myStepper.accelerationEnable(3, 15, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+    myStepper.begin();
+}
+
+void loop() {
+    //Speed changes at any time, the motor ramps to the new one.
+    myStepper.runSpeed(15);
+    delay(1000);
+    myStepper.runSpeed(6);
+    delay(1000);
+    myStepper.runSpeed(-10);  //Slows down to minSpeed, then turns back
+    delay(1000);
+
+    myStepper.runSpeed(0);
+    myStepper.waitUntilArrived();
+    Serial.print("Stopped at ");
+    Serial.println(myStepper.whatStepNumber());
+    delay(500);
+}
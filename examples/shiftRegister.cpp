@@ -0,0 +1,45 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+#include <SmoothStepperGroup.h>
+
+const int stepsPerRevolution = 2048;
+
+//4 daisy-chained 74HC595: SER on 23, SRCLK on 18, RCLK on 5.
+//Two motors per register, their pins are the Q outputs 0 to 31.
+BoardShiftRegister chain(4, 23, 18, 5);
+SmoothStepperMotor<4> *motors[8];
+SmoothStepperGroup group;
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!chain.begin()) {
+        Serial.println("SPI bus not available");
+        while (1) {
+        }
+    }
+
+    for (int motor = 0; motor < 8; motor++) {
+        int q = 4 * motor;
+        motors[motor] = new SmoothStepperMotor<4>(&chain, stepsPerRevolution, q, q + 1, q + 2, q + 3);
+        motors[motor]->accelerationEnable(3, 15, 500);
+        //The coils of all the motors stepping together are sent in one transfer.
+        group.add(motors[motor]);
+    }
+    group.begin();
+}
+
+void loop() {
+    unsigned long transfers = chain.transfers();
+    for (int motor = 0; motor < 8; motor++) {
+        motors[motor]->step(motor % 2 ? -500 : 500);
+    }
+    if (!group.waitAll(5000)) {
+        Serial.println("Not arrived after 5s");
+    }
+
+    Serial.print("SPI transfers for 8 x 500 steps: ");
+    Serial.println(chain.transfers() - transfers);
+    delay(500);
+}
@@ -0,0 +1,42 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 2048;
+
+//Motors, their tasks and the stacks are all global: no heap for them,
+//the RAM used is known at link time.
+SmoothStepperMotor<4> conveyor(stepsPerRevolution, 23, 22, 21, 19);
+SmoothStepperMotor<4> feeder(stepsPerRevolution, 18, 5, 17, 16);
+StepperTaskMemory<1536> conveyorTask;
+StepperTaskMemory<1536> feederTask;
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!conveyor.accelerationEnable(3, 15, 500) || !feeder.accelerationEnable(3, 10, 300)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //Core and priority of each step task.
+    conveyor.begin(conveyorTask.config(0, 2));
+    feeder.begin(feederTask.config(0, 1));
+
+    Serial.print("Bytes per motor: ");
+    Serial.println((unsigned long)(sizeof(conveyor) + sizeof(conveyorTask)));
+}
+
+void loop() {
+    conveyor.step(1000);
+    feeder.step(-300);
+    conveyor.waitUntilArrived();
+    feeder.waitUntilArrived();
+
+    Serial.print("Arrived at ");
+    Serial.print(conveyor.whatStepNumber());
+    Serial.print(" ");
+    Serial.println(feeder.whatStepNumber());
+    delay(500);
+}
@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 200 * 16;  // 1.8° motor, 1/16 microsteps
+
+//A4988 or TMC driver: STEP on pin 26, DIR on pin 25.
+SmoothStepper myStepper(stepsPerRevolution);
+BoardPulseGenerator pulses(26, 25);
+
+void setup() {
+    Serial.begin(115200);
+
+    if (!myStepper.accelerationEnable(30, 600, 300)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //The steps are planned in chunks and played by the RMT, not by the CPU.
+    if (!pulses.begin()) {
+        Serial.println("No RMT channel left");
+        while (1) {
+        }
+    }
+    myStepper.begin(&pulses);
+}
+
+void loop() {
+    //32000 steps/s at 600 rev/min.
+    myStepper.step(10 * stepsPerRevolution);
+    myStepper.waitUntilArrived();
+    myStepper.step(-10 * stepsPerRevolution);
+    myStepper.waitUntilArrived();
+
+    Serial.print("Arrived at ");
+    Serial.println(myStepper.whatStepNumber());
+    delay(500);
+}
@@ -0,0 +1,30 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 2048;
+
+SmoothStepper smoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+BoardStepperTimer stepperTimer;
+
+void setup() {
+    Serial.begin(115200);
+
+    if (!smoothStepper.accelerationEnable(3, 15, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+
+    //Steps are done by the timer, no need to disable the core 0 watchdog.
+    smoothStepper.begin(&stepperTimer);
+}
+
+void loop() {
+    int a = random(-600, 600);
+
+    smoothStepper.absolutePosition(a);
+    delay(2000);
+
+    smoothStepper.absolutePosition(-a);
+    delay(2000);
+}
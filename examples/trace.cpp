@@ -0,0 +1,52 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+#include <stdio.h>
+
+const int stepsPerRevolution = 2048;  // change this to fit the number of steps per revolution for your motor
+
+SmoothStepper myStepper(stepsPerRevolution, 23, 22, 21, 19);
+
+//About 1 byte per step at constant speed, 2 while changing speed.
+uint8_t traceBuffer[4096];
+StepTraceLog trace(traceBuffer, sizeof(traceBuffer));
+
+//Hex lines, decoded on the computer by extras/tools/traceDecode.cpp
+void dumpTrace() {
+    uint8_t bytes[32];
+    size_t count;
+    while ((count = trace.read(bytes, sizeof(bytes))) > 0) {
+        char line[2 * sizeof(bytes) + 1];
+        for (size_t i = 0; i < count; i++) {
+            snprintf(line + 2 * i, 3, "%02x", bytes[i]);
+        }
+        Serial.println(line);
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    if (!myStepper.accelerationEnable(3, 15, 500)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+    myStepper.setTrace(&trace);
+    myStepper.begin();
+}
+
+void loop() {
+    myStepper.step(1500);
+    delay(1500);
+    myStepper.absolutePosition(0);  //Turns back before the end of the move
+    myStepper.waitUntilArrived();
+
+    dumpTrace();
+    if (trace.dropped() > 0) {
+        Serial.print("Dropped records: ");
+        Serial.println((unsigned long)trace.dropped());
+    }
+    delay(500);
+}
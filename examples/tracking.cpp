@@ -0,0 +1,31 @@
+#include <Arduino.h>
+#include <SmoothStepper.h>
+
+const int stepsPerRevolution = 2048;  // change this to fit the number of steps per revolution for your motor
+
+//Follows a target which moves on its own, like a camera following an object.
+SmoothStepper myStepper(stepsPerRevolution, 23, 22, 21, 19);
+
+void setup() {
+    Serial.begin(115200);
+
+    disableCore0WDT();
+    myStepper.setRampBackend(SmoothStepper::RAMP_EXACT);  // Reaches the target at its speed
+    if (!myStepper.accelerationEnable(3, 30, 300)) {
+        Serial.println("Non correct parameter(s)");
+        while (1) {
+        }
+    }
+    myStepper.begin();
+}
+
+void loop() {
+    //The target swings 200 steps each way in 2 s, its position is sent at 100 Hz.
+    for (int i = 0; i < 200; i++) {
+        myStepper.trackPosition(200 * sin(2 * PI * i / 200.0));
+        delay(10);
+    }
+
+    Serial.print("Position ");
+    Serial.println(myStepper.whatStepNumber());
+}
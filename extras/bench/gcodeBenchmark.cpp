@@ -0,0 +1,169 @@
+/*
+ * gcodeBenchmark.cpp - Streaming a G-code program to two coordinated axes.
+ *
+ * Sends a program (a file, or the built-in one) at the rate of a
+ * 115200 or 9600 baud serial port to a SmoothStepperGcode on the simulator with
+ * the timer engine, in two ways:
+ *   - streamed: the bytes are written as they come, the next blocks wait
+ *     in the move queue while the current one is stepped;
+ *   - lockstep: a line is sent only once the previous one is done, like
+ *     a sender waiting for "ok" after each move.
+ * Prints the total execution time, the time the axes were idle waiting
+ * for a line (starved) and the shortest step interval of the axes, from
+ * their state after each tick: a move following another one without a
+ * gap starts one interval at the minimum speed after its last step, the
+ * shortest interval is the one at full speed. Prints CSV.
+ *
+ * Built by the CMake host build: ./gcodeBenchmark [program.gcode]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+#include "SmoothStepperCoordinator.h"
+#include "SmoothStepperGcode.h"
+
+const int stepsPerRevolution = 2048;
+const float stepsPerMm = 2048 / 40.0;  // 40 mm per revolution
+const unsigned long tick = 20;         // us
+
+static const char program[] =
+    "; Square, diagonals and a dwell\n"
+    "G21 G90\n"
+    "M17\n"
+    "G0 X0 Y0\n"
+    "G1 X20 F300\n"
+    "G1 Y20\n"
+    "G1 X0\n"
+    "G1 Y0\n"
+    "G4 P100 (settle)\n"
+    "G1 X20 Y20 F450\n"
+    "G0 X0 Y20\n"
+    "G1 X20 Y0\n"
+    "; Polygon of short segments, 100 ms each\n"
+    "G1 X25 Y5 F300\n"
+    "G1 X25.5 Y5\n"
+    "G1 X26 Y5.5\n"
+    "G1 X26 Y6\n"
+    "G1 X25.5 Y6.5\n"
+    "G1 X25 Y6.5\n"
+    "G1 X24.5 Y6\n"
+    "G1 X24.5 Y5.5\n"
+    "G1 X25 Y5\n"
+    "G91\n"
+    "G1 X-2 Y2\n"
+    "X-2 Y2\n"
+    "X-2 Y2\n"
+    "X-2 Y2\n"
+    "X-2 Y2\n"
+    "G90\n"
+    "G28\n"
+    "M18\n";
+
+// Shortest interval (us) between two steps of an axis, from its state after
+// each tick (several steps in one tick count as no interval)
+struct StepIntervals {
+    long position = 0;
+    unsigned long last_step = 0;
+    bool stepped = false;  // The first step has no interval
+    unsigned long shortest = (unsigned long)-1;
+
+    void update(const SmoothStepper::State &state) {
+        long steps = labs(state.position - this->position);
+        if (steps == 0) return;
+        if (steps > 1) {
+            this->shortest = 0;
+        } else if (this->stepped && state.last_step - this->last_step < this->shortest) {
+            this->shortest = state.last_step - this->last_step;
+        }
+        this->position = state.position;
+        this->last_step = state.last_step;
+        this->stepped = true;
+    }
+};
+
+static void run(const std::string &text, bool lockstep, long baud) {
+    double bytesPerUs = baud / 10 / 1e6;  // 10 bits per byte
+    BoardStepperTimer timer;
+    SmoothStepper axisX(stepsPerRevolution, 23, 22, 21, 19);
+    SmoothStepper axisY(stepsPerRevolution, 18, 5, 17, 16);
+    SmoothStepperCoordinator axes;
+    axes.add(&axisX);
+    axes.add(&axisY);
+    axes.begin(&timer);
+
+    SmoothStepperGcode gcode(&axes);
+    gcode.setStepsPerUnit(stepsPerMm);
+    gcode.accelerationEnable(120, 600, 500);
+
+    VirtualClock &clock = simulatorClock();
+    unsigned long start = clock.micros();
+    unsigned long lineStart = start;  // On the wire (lockstep), 0 while waiting for "ok"
+    size_t lineFrom = 0;
+    size_t written = 0;
+    unsigned long starved = 0;  // us
+    StepIntervals intervalsX, intervalsY;
+    intervalsX.position = axisX.snapshot().position;
+    intervalsY.position = axisY.snapshot().position;
+
+    while (written < text.size() || !gcode.isIdle()) {
+        clock.advance(tick);
+        intervalsX.update(axisX.snapshot());
+        intervalsY.update(axisY.snapshot());
+
+        size_t received;  // Bytes on our side of the wire
+        if (!lockstep) {
+            received = (size_t)((clock.micros() - start) * bytesPerUs);
+        } else {
+            if (lineStart == 0 && gcode.isIdle()) {
+                lineStart = clock.micros();
+                lineFrom = written;
+            }
+            received = written;
+            if (lineStart != 0) {
+                received = lineFrom + (size_t)((clock.micros() - lineStart) * bytesPerUs);
+                size_t end = text.find('\n', lineFrom);
+                if (end != std::string::npos && received > end + 1) received = end + 1;
+            }
+        }
+        if (received > text.size()) received = text.size();
+
+        written += gcode.write(reinterpret_cast<const uint8_t *>(text.data()) + written, received - written);
+        if (lockstep && written > lineFrom && text[written - 1] == '\n') lineStart = 0;
+        if (written < text.size() && gcode.isIdle()) starved += tick;
+    }
+
+    printf("%s,%ld,%lu,%lu,%.1f,%.1f,%lu\n", lockstep ? "lockstep" : "streamed", baud, gcode.lines(), gcode.errors(),
+           (clock.micros() - start) / 1000.0, starved / 1000.0,
+           intervalsX.shortest < intervalsY.shortest ? intervalsX.shortest : intervalsY.shortest);
+}
+
+int main(int argc, char **argv) {
+    std::string text = program;
+    if (argc > 1) {
+        FILE *file = fopen(argv[1], "rb");
+        if (file == nullptr) {
+            printf("Cannot open %s\n", argv[1]);
+            return 1;
+        }
+        text.clear();
+        char buffer[256];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, length);
+        fclose(file);
+        if (!text.empty() && text.back() != '\n') text += '\n';
+    }
+
+    printf("sender,baud,lines,errors,totalMs,starvedMs,shortestStepUs\n");
+    const long bauds[] = {115200, 9600};
+    for (int i = 0; i < 2; i++) {
+        run(text, false, bauds[i]);
+        run(text, true, bauds[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * gpioBenchmark.cpp - Number of GPIO writes per motor step.
+ *
+ * Counts the GPIO writes of the simulator while single motors of 2, 4 and
+ * 5 pins, a group of motors and coordinated axes move. Before the phase
+ * masks each step wrote every pin of the motor with its own digitalWrite().
+ * Prints CSV.
+ *
+ * Built by the CMake host build: ./gpioBenchmark
+ */
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+#include "SmoothStepperCoordinator.h"
+#include "SmoothStepperGroup.h"
+
+const int stepsPerRevolution = 2048;
+const long steps = 2000;
+const int motors = 4;
+
+static void print(const char *mode, int count, int pins, unsigned long writes) {
+    long motorSteps = steps * count;
+    printf("%s,%d,%ld,%lu,%.2f,%d\n", mode, count, motorSteps, writes,
+           (double)writes / motorSteps, pins);
+}
+
+static void single(int pins) {
+    BoardStepperTimer timer;
+    SmoothStepper *stepper;
+    if (pins == 2) stepper = new SmoothStepper(stepsPerRevolution, 23, 22);
+    else if (pins == 4) stepper = new SmoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+    else stepper = new SmoothStepper(stepsPerRevolution, 23, 22, 21, 19, 18);
+    stepper->accelerationEnable(3, 15, 500);
+    stepper->begin(&timer);
+
+    unsigned long start = simulatorPinWrites();
+    stepper->step(steps);
+    stepper->waitUntilArrived();
+
+    char mode[16];
+    snprintf(mode, sizeof(mode), "single %d pins", pins);
+    print(mode, 1, pins, simulatorPinWrites() - start);
+    delete stepper;
+}
+
+static void group() {
+    BoardStepperTimer timer;
+    SmoothStepperGroup group;
+    SmoothStepper *steppers[motors];
+    for (int motor = 0; motor < motors; motor++) {
+        steppers[motor] = new SmoothStepper(stepsPerRevolution, 4 * motor, 4 * motor + 1,
+                                            4 * motor + 2, 4 * motor + 3);
+        steppers[motor]->accelerationEnable(3, 15, 500);
+        group.add(steppers[motor]);
+    }
+    group.begin(&timer);
+
+    unsigned long start = simulatorPinWrites();
+    for (int motor = 0; motor < motors; motor++) {
+        steppers[motor]->step(steps);
+    }
+    for (int motor = 0; motor < motors; motor++) {
+        steppers[motor]->waitUntilArrived();
+    }
+    print("group 4 pins", motors, 4, simulatorPinWrites() - start);
+
+    for (int motor = 0; motor < motors; motor++) {
+        delete steppers[motor];
+    }
+}
+
+static void coordinated() {
+    BoardStepperTimer timer;
+    SmoothStepperCoordinator axes;
+    SmoothStepper *steppers[motors];
+    long move[motors];
+    for (int motor = 0; motor < motors; motor++) {
+        steppers[motor] = new SmoothStepper(stepsPerRevolution, 4 * motor, 4 * motor + 1,
+                                            4 * motor + 2, 4 * motor + 3);
+        axes.add(steppers[motor]);
+        move[motor] = steps;
+    }
+    axes.accelerationEnable(3, 15, 500);
+    axes.begin(&timer);
+
+    unsigned long start = simulatorPinWrites();
+    axes.move(move);
+    axes.waitUntilArrived();
+    print("coordinated 4 pins", motors, 4, simulatorPinWrites() - start);
+
+    for (int motor = 0; motor < motors; motor++) {
+        delete steppers[motor];
+    }
+}
+
+int main() {
+    printf("mode,motors,motorSteps,gpioWrites,gpioWritesPerStep,digitalWritesPerStepBefore\n");
+    single(2);
+    single(4);
+    single(5);
+    group();
+    coordinated();
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * lookAheadBenchmark.cpp - Total time of a chain of short moves.
+ *
+ * The same chain of moves is done one by one (waiting for the arrival
+ * between moves) and through the motion queue with several look ahead
+ * depths, on the virtual clock of the simulator. Prints CSV.
+ *
+ * Built by the CMake host build: ./lookAheadBenchmark
+ */
+#include "Arduino.h"
+#include "SmoothStepper.h"
+
+const int stepsPerRevolution = 2048;
+const int moves = 40;
+
+// Chain of short moves, mostly in the same direction
+static int move(int i) { return (i % 10 == 9) ? -300 : 150 + (i % 3) * 50; }
+
+static unsigned long run(int lookAhead) {
+    BoardStepperTimer timer;
+    SmoothStepper smoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+    smoothStepper.accelerationEnable(3, 15, 500);
+    smoothStepper.begin(&timer);
+
+    unsigned long start = millis();
+    for (int i = 0; i < moves; i++) {
+        if (lookAhead == 0) {
+            smoothStepper.step(move(i));
+            smoothStepper.waitUntilArrived();
+            continue;
+        }
+        smoothStepper.setLookAhead(lookAhead);
+        while (!smoothStepper.queueMove(move(i))) {
+            stepperYield();
+        }
+    }
+    smoothStepper.waitUntilArrived();
+    return millis() - start;
+}
+
+int main() {
+    printf("mode,moves,total_ms\n");
+    printf("one by one,%d,%lu\n", moves, run(0));
+    const int lookAheads[] = {1, 2, 4, 8};
+    for (int lookAhead : lookAheads) {
+        printf("look ahead %d,%d,%lu\n", lookAhead, moves, run(lookAhead));
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * plannerBenchmark.cpp - Move time and creep of the ramp planners.
+ *
+ * Plays moves of a sweep of distances from standstill with each ramp
+ * backend on a STEP/DIR motor of the simulator, and reads the recorded
+ * pulses: the time from the first to the last step, against the one of
+ * the ideal trapezoid (or triangle) between the same steps, the steps
+ * crept at vmin at the end of the move and the steps past the target.
+ * Prints CSV.
+ *
+ * Built by the CMake host build: ./plannerBenchmark [minSpeed maxSpeed rampTime]
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+
+const int stepsPerRevolution = 2048;
+const long distances[] = {2, 5, 10, 20, 50, 100, 150, 200, 300, 500, 800, 1000, 2000, 5000};
+
+static float minSpeed = 3;   // rev/min
+static float maxSpeed = 15;  // rev/min
+static long rampTime = 500;  // ms
+
+/*
+ * Time (ms) of the ideal profile from the first to the last step of a
+ * move: the first step is done at once by the motor.
+ */
+static double idealTime(long steps) {
+    double vmin = minSpeed * stepsPerRevolution / 60 / 1000;  // step/ms
+    double vmax = maxSpeed * stepsPerRevolution / 60 / 1000;  // step/ms
+    double acc = (vmax - vmin) / rampTime;                    // step/ms²
+
+    // Time to go from 0 to a position of the move
+    double peak = sqrt(vmin * vmin + acc * steps);
+    if (peak > vmax) peak = vmax;
+    double ramp = (peak * peak - vmin * vmin) / (2 * acc);  // steps of each ramp
+    double total = 2 * (peak - vmin) / acc + (steps - 2 * ramp) / peak;
+    double first = (sqrt(vmin * vmin + 2 * acc) - vmin) / acc;
+    return steps == 1 ? 0 : total - (first < total ? first : total);
+}
+
+static void run(SmoothStepper::RampBackend backend, const char *name) {
+    double vminInterval = 60.0 * 1000 * 1000 / minSpeed / stepsPerRevolution;  // us
+
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+        long steps = distances[i];
+        BoardPulseGenerator pulses(26, 25);
+        pulses.begin();
+        SmoothStepper stepper(stepsPerRevolution);
+        stepper.setRampBackend(backend);
+        stepper.accelerationEnable(minSpeed, maxSpeed, rampTime);
+        stepper.begin(&pulses);
+
+        size_t first = simulatorPulses().size();
+        stepper.step(steps);
+        stepper.waitUntilArrived();
+        const std::vector<SimulatorPulse> &played = simulatorPulses();
+
+        long position = 0;
+        long farthest = 0;
+        for (size_t pulse = first; pulse < played.size(); pulse++) {
+            position += played[pulse].direction;
+            if (position > farthest) farthest = position;
+        }
+
+        // Last steps at vmin, the ideal profile is above it until the target
+        long creep = 0;
+        for (size_t pulse = played.size() - 1; pulse > first; pulse--) {
+            if (played[pulse].date - played[pulse - 1].date < 0.98 * vminInterval) break;
+            creep++;
+        }
+
+        printf("%s,%ld,%.1f,%.1f,%ld,%ld,%ld\n", name, steps,
+               (played.back().date - played[first].date) / 1000.0, idealTime(steps), creep,
+               farthest - steps, position);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        minSpeed = atof(argv[1]);
+        maxSpeed = atof(argv[2]);
+        rampTime = atol(argv[3]);
+    }
+
+    printf("planner,steps,moveMs,idealMs,creepSteps,overshootSteps,position\n");
+    run(SmoothStepper::RAMP_FLOAT, "float");
+    run(SmoothStepper::RAMP_FIXED, "fixed");
+    run(SmoothStepper::RAMP_EXACT, "exact");
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * pulseBenchmark.cpp - Wake-ups per step of the STEP/DIR pulse mode.
+ *
+ * Moves a motor forth and back with the coil engine (one timer callback
+ * per step) and with the STEP/DIR engine (one task turn per chunk of
+ * pulses). On the board each wake-up costs a context switch or an
+ * interrupt, which is what bounds the step rate of the coil engine.
+ * Also prints the host CPU time per step and checks the pulses recorded
+ * by the simulator against the planned position. Prints CSV.
+ *
+ * Built by the CMake host build: ./pulseBenchmark
+ */
+#include <chrono>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+
+const int stepsPerRevolution = 3200;
+const long steps = 64000;
+
+static unsigned long wakeUps;
+
+static void print(const char *mode, long motorSteps, double ns, long pulses, long position,
+                  unsigned long minInterval) {
+    printf("%s,%ld,%.3f,%.1f,%ld,%ld,%lu\n", mode, motorSteps, (double)wakeUps / motorSteps, ns,
+           pulses, position, minInterval);
+}
+
+// Move forth and back, return the CPU time (ns) per step
+static double run(SmoothStepper *stepper) {
+    unsigned long dispatches = simulatorClock().dispatches();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stepper->step(steps);
+    stepper->waitUntilArrived();
+    stepper->step(-steps / 2);
+    stepper->waitUntilArrived();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    wakeUps = simulatorClock().dispatches() - dispatches;
+    return std::chrono::duration<double, std::nano>(end - start).count() / (steps + steps / 2);
+}
+
+static void coils() {
+    BoardStepperTimer timer;
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(30, 600, 300);
+    stepper.begin(&timer);
+
+    double ns = run(&stepper);
+    print("coils timer", steps + steps / 2, ns, 0, stepper.whatRotationNumber() * stepsPerRevolution, 0);
+}
+
+static void stepDir() {
+    BoardPulseGenerator pulses(26, 25);
+    pulses.begin();
+    SmoothStepper stepper(stepsPerRevolution);
+    stepper.accelerationEnable(30, 600, 300);
+    stepper.begin(&pulses);
+
+    double ns = run(&stepper);
+
+    // What the generator played
+    long position = 0;
+    unsigned long minInterval = (unsigned long)-1;
+    const std::vector<SimulatorPulse> &played = simulatorPulses();
+    for (size_t i = 0; i < played.size(); i++) {
+        position += played[i].direction;
+        if (i > 0 && played[i].date - played[i - 1].date < minInterval) {
+            minInterval = played[i].date - played[i - 1].date;
+        }
+    }
+    print("step/dir pulses", steps + steps / 2, ns, played.size(), position, minInterval);
+}
+
+int main() {
+    printf("mode,motorSteps,wakeUpsPerStep,cpuNsPerStep,pulsesPlayed,positionPlayed,minIntervalUs\n");
+    coils();
+    stepDir();
+    return 0;
+}
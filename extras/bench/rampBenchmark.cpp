@@ -0,0 +1,86 @@
+/*
+ * rampBenchmark.cpp - Per step cost of the float, fixed point, exact and S-curve ramps.
+ *
+ * Times updateDelay() alone with each ramp on the real clock of the host,
+ * like the updateDelay lines of stepBenchmark, and runs the same moves with
+ * each ramp on the virtual clock of the simulator for their total time.
+ * Prints a CSV line per ramp.
+ *
+ * Built by the CMake host build: ./rampBenchmark
+ */
+#include <chrono>
+
+#include "Arduino.h"
+#include "SmoothStepper.h"
+#include "SmoothStepperBenchmark.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static unsigned long long cycles() { return __rdtsc(); }
+#else
+static unsigned long long cycles() { return 0; }
+#endif
+
+const int stepsPerRevolution = 2048;
+const int moves = 200;
+const long iterations = 1000000;  // updateDelay() calls
+
+/*
+ * Real time clock of the host.
+ */
+class SteadyClock : public StepperClock {
+   public:
+    unsigned long micros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+};
+
+static void output(const char *) {}
+
+static void run(SmoothStepper::RampBackend backend, long jerkTime, const char *name) {
+    SteadyClock steadyClock;
+    SmoothStepperBenchmark benchmark(&steadyClock, output);
+    unsigned long long start_cycles = cycles();
+    double update_ns = benchmark.updateDelayCost(backend, jerkTime, iterations);
+    unsigned long long update_cycles = cycles() - start_cycles;
+
+    VirtualClock &clock = simulatorClock();
+    VirtualStepperTimer timer(clock);
+    SmoothStepper smoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+
+    smoothStepper.accelerationEnable(3, 15, 500);
+    smoothStepper.setRampBackend(backend);
+    smoothStepper.setJerk(jerkTime);
+    smoothStepper.begin(&timer);
+
+    long steps = 0;
+    long position = 0;
+    srand(1);
+    unsigned long start_time = clock.micros();
+
+    for (int i = 0; i < moves; i++) {
+        long target = rand() % 4000 - 2000;
+        steps += labs(target - position);
+        position = target;
+
+        smoothStepper.absolutePosition(target);
+        while (smoothStepper.isArrived()) {
+            clock.advance(1000);
+        }
+    }
+
+    unsigned long move_ms = (clock.micros() - start_time) / 1000;
+
+    printf("%s,%ld,%.1f,%.1f,%lu\n", name, steps, update_ns, (double)update_cycles / iterations, move_ms);
+}
+
+int main() {
+    printf("backend,steps,updateDelay_ns,updateDelay_cycles,move_ms\n");
+    run(SmoothStepper::RAMP_FLOAT, 0, "float");
+    run(SmoothStepper::RAMP_FIXED, 0, "fixed");
+    run(SmoothStepper::RAMP_EXACT, 0, "exact");
+    run(SmoothStepper::RAMP_FLOAT, 100, "scurve");
+    return 0;
+}
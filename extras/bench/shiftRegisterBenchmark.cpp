@@ -0,0 +1,115 @@
+/*
+ * shiftRegisterBenchmark.cpp - SPI transfers per motor step on a chain of
+ * 74HC595 shift registers.
+ *
+ * 1 to 16 four-wire motors (2 per register) move on the host stand-in of
+ * BoardShiftRegister, stepped by their own timers, by a group or as
+ * coordinated axes. Every recorded frame is checked (each motor energizes
+ * 2 coils or none yet, the bytes are the frame with the last register
+ * first) and the last one is compared with the pins written by the same
+ * motors on GPIO.
+ * Prints CSV.
+ *
+ * Built by the CMake host build: ./shiftRegisterBenchmark
+ */
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+#include "SmoothStepperCoordinator.h"
+#include "SmoothStepperGroup.h"
+
+const int stepsPerRevolution = 2048;
+const long steps = 2000;
+
+enum Mode { SINGLE, GROUP, GROUP_SPEEDS, COORDINATED };
+static const char *modes[] = {"single", "group", "group mixed speeds", "coordinated"};
+
+// Run the motors on the chain, or on GPIO when chain is nullptr
+static void run(Mode mode, int count, BoardShiftRegister *chain) {
+    BoardStepperTimer timers[16];
+    SmoothStepperGroup group;
+    SmoothStepperCoordinator axes;
+    SmoothStepper *steppers[16];
+    long move[16];
+    for (int motor = 0; motor < count; motor++) {
+        int pin = 4 * motor;
+        if (chain != nullptr) {
+            steppers[motor] = new SmoothStepperMotor<4>(chain, stepsPerRevolution, pin, pin + 1, pin + 2, pin + 3);
+        } else {
+            steppers[motor] = new SmoothStepperMotor<4>(stepsPerRevolution, pin, pin + 1, pin + 2, pin + 3);
+        }
+        steppers[motor]->accelerationEnable(3, mode == GROUP_SPEEDS ? 10 + motor : 15, 500);
+        move[motor] = steps;
+        if (mode == SINGLE) steppers[motor]->begin(&timers[motor]);
+        if (mode == GROUP || mode == GROUP_SPEEDS) group.add(steppers[motor]);
+        if (mode == COORDINATED) axes.add(steppers[motor]);
+    }
+
+    if (mode == COORDINATED) {
+        axes.accelerationEnable(3, 15, 500);
+        axes.begin(&timers[0]);
+        axes.move(move);
+        axes.waitUntilArrived();
+    } else {
+        if (mode != SINGLE) group.begin(&timers[0]);
+        for (int motor = 0; motor < count; motor++) {
+            steppers[motor]->step(steps);
+        }
+        for (int motor = 0; motor < count; motor++) {
+            steppers[motor]->waitUntilArrived();
+        }
+    }
+
+    for (int motor = 0; motor < count; motor++) {
+        delete steppers[motor];
+    }
+}
+
+// Frames of the chain that are not a valid coil state or not sent as their bytes
+static long badFrames(const BoardShiftRegister *chain, size_t first, int count) {
+    const std::vector<SimulatorTransfer> &transfers = simulatorTransfers();
+    long bad = 0;
+    for (size_t i = first; i < transfers.size(); i++) {
+        const SimulatorTransfer &transfer = transfers[i];
+        if (transfer.chain != chain) continue;
+        bool valid = true;
+        for (int motor = 0; motor < count; motor++) {
+            int coils = __builtin_popcountll(transfer.frame >> (4 * motor) & 0xF);
+            valid = valid && (coils == 2 || coils == 0);  // 0 before the first step
+        }
+        for (int byte = 0; byte < transfer.length; byte++) {
+            valid = valid && transfer.bytes[byte] == (uint8_t)(transfer.frame >> (8 * (transfer.length - 1 - byte)));
+        }
+        bad += !valid;
+    }
+    return bad;
+}
+
+static void bench(Mode mode, int count) {
+    run(mode, count, nullptr);
+    StepperPinMask gpio = 0;
+    for (int pin = 0; pin < 4 * count; pin++) {
+        gpio |= (StepperPinMask)simulatorPinLevel(pin) << pin;
+    }
+
+    BoardShiftRegister chain((count + 1) / 2, 23, 18, 5);
+    chain.begin();
+    size_t first = simulatorTransfers().size();  // After the frame of begin()
+    unsigned long start = chain.transfers();
+    run(mode, count, &chain);
+
+    unsigned long transfers = chain.transfers() - start;
+    long motorSteps = steps * count;
+    printf("%s,%d,%d,%ld,%lu,%.3f,%ld,%s\n", modes[mode], count, (count + 1) / 2, motorSteps, transfers,
+           (double)transfers / motorSteps, badFrames(&chain, first, count), chain.frame() == gpio ? "yes" : "no");
+}
+
+int main() {
+    printf("mode,motors,registers,motorSteps,transfers,transfersPerStep,badFrames,sameAsGpio\n");
+    const int counts[] = {1, 2, 4, 8, 16};
+    for (int i = 0; i < 5; i++) bench(SINGLE, counts[i]);
+    for (int i = 0; i < 5; i++) bench(GROUP, counts[i]);
+    for (int i = 0; i < 5; i++) bench(GROUP_SPEEDS, counts[i]);
+    for (int i = 0; i < 3; i++) bench(COORDINATED, counts[i]);
+    return 0;
+}
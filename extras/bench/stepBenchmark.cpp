@@ -0,0 +1,37 @@
+/*
+ * stepBenchmark.cpp - Step timing benchmarks on the host.
+ *
+ * Prints the CSV of SmoothStepperBenchmark measured with the real clock
+ * of the host (the step path itself runs on the simulator HAL).
+ *
+ * Built by the CMake host build: ./stepBenchmark [max motors, default 16]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "SmoothStepperBenchmark.h"
+
+/*
+ * Real time clock of the host.
+ */
+class SteadyClock : public StepperClock {
+   public:
+    unsigned long micros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+};
+
+static void output(const char *line) { puts(line); }
+
+int main(int argc, char **argv) {
+    int maxMotors = argc > 1 ? atoi(argv[1]) : 16;
+
+    SteadyClock clock;
+    SmoothStepperBenchmark benchmark(&clock, output);
+    benchmark.runAll(maxMotors);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * trackingBenchmark.cpp - Following a target updated at 100 Hz.
+ *
+ * Sends the position of a moving target (constant speed, then a sine)
+ * every 10 ms with absolutePosition() and with trackPosition(), with the
+ * RAMP_EXACT backend and the timer engine, and prints the tracking error
+ * and the share of the steps spent changing speed. Prints CSV.
+ *
+ * Built by the CMake host build: ./trackingBenchmark
+ */
+#include <math.h>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+
+const int stepsPerRevolution = 2048;
+const int updates = 1000;         // Of the target
+const unsigned long period = 10;  // ms between updates
+
+// Position of the target at t (s)
+static double target(int profile, double t) {
+    if (profile == 0) return 300 * t;      // 300 step/s
+    return 200 * sin(2 * M_PI * 0.5 * t);  // 200 steps at 0.5 Hz
+}
+
+static void run(int profile, bool track) {
+    BoardStepperTimer timer;
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.setRampBackend(SmoothStepper::RAMP_EXACT);
+    stepper.accelerationEnable(3, 30, 300);
+    stepper.begin(&timer);
+
+    VirtualClock &clock = simulatorClock();
+    unsigned long start = clock.micros();
+    double error2 = 0;
+    double maxError = 0;
+    long samples = 0;
+    long steps = 0;
+    long ramping = 0;  // Steps with another interval than the previous one
+    long position = 0;
+    unsigned long lastStep = start, lastInterval = 0;
+
+    for (int update = 0; update < updates; update++) {
+        long goal = lround(target(profile, (clock.micros() - start) / 1e6));
+        if (track) {
+            stepper.trackPosition(goal);
+        } else {
+            stepper.absolutePosition(goal);
+        }
+
+        // Watch the motor every 10 us until the next update
+        for (unsigned long tick = 0; tick < period * 100; tick++) {
+            clock.advance(10);
+            long now = stepper.whatRotationNumber() * stepsPerRevolution + stepper.whatStepNumber();
+            if (now != position) {
+                unsigned long interval = clock.micros() - lastStep;
+                if (lastInterval > 0 && fabs((double)interval - lastInterval) > 0.02 * lastInterval) ramping++;
+                lastInterval = interval;
+                lastStep = clock.micros();
+                position = now;
+                steps++;
+            }
+            double error = fabs(position - target(profile, (clock.micros() - start) / 1e6));
+            error2 += error * error;
+            if (error > maxError) maxError = error;
+            samples++;
+        }
+    }
+
+    printf("%s,%s,%.1f,%.1f,%ld,%.2f\n", profile == 0 ? "ramp" : "sine", track ? "trackPosition" : "absolutePosition",
+           sqrt(error2 / samples), maxError, steps, steps > 0 ? (double)ramping / steps : 0);
+}
+
+int main() {
+    printf("target,command,rmsErrorSteps,maxErrorSteps,steps,rampingShare\n");
+    for (int profile = 0; profile < 2; profile++) {
+        run(profile, false);
+        run(profile, true);
+    }
+    return 0;
+}
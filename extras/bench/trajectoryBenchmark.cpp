@@ -0,0 +1,69 @@
+/*
+ * trajectoryBenchmark.cpp - Production cycle played live and from the
+ * trajectory cache.
+ *
+ * Repeats a cycle of a few moves with the live planner and through a
+ * SmoothTrajectoryCache of a given RAM budget, and prints the host CPU
+ * time per step, the cache hit rate and the memory used. Prints CSV.
+ *
+ * Built by the CMake host build: ./trajectoryBenchmark [budget bytes, default 8192]
+ */
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "SmoothStepper.h"
+#include "SmoothTrajectoryCache.h"
+
+const int stepsPerRevolution = 2048;
+const long cycle[] = {2000, -500, 1500, -3000};
+const int moves = sizeof(cycle) / sizeof(cycle[0]);
+const int cycles = 100;
+
+// Run the cycles, return the CPU time (ns) per step
+static double run(SmoothStepper *stepper, SmoothTrajectoryCache *cache) {
+    long steps = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++) {
+        for (int move = 0; move < moves; move++) {
+            if (cache != nullptr) {
+                cache->step(stepper, cycle[move]);
+            } else {
+                stepper->step(cycle[move]);
+            }
+            stepper->waitUntilArrived();
+            steps += labs(cycle[move]);
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / steps;
+}
+
+int main(int argc, char **argv) {
+    size_t budget = argc > 1 ? atol(argv[1]) : 8192;
+    const SmoothStepper::RampBackend backends[] = {SmoothStepper::RAMP_FLOAT, SmoothStepper::RAMP_FIXED,
+                                                   SmoothStepper::RAMP_FLOAT};
+    const long jerkTimes[] = {0, 0, 100};
+    const char *names[] = {"float", "fixed", "scurve"};
+
+    printf("ramp,mode,cpuNsPerStep,hitRate,memoryBytes,cachedMoves\n");
+    for (int backend = 0; backend < 3; backend++) {
+        BoardStepperTimer timer;
+        SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+        stepper.setRampBackend(backends[backend]);
+        stepper.setJerk(jerkTimes[backend]);
+        stepper.accelerationEnable(3, 15, 500);
+        stepper.begin(&timer);
+
+        double live = run(&stepper, nullptr);
+        printf("%s,live,%.1f,,,\n", names[backend], live);
+
+        SmoothTrajectoryCache cache(budget);
+        double cached = run(&stepper, &cache);
+        printf("%s,cache,%.1f,%.3f,%zu,%d\n", names[backend], cached, cache.hitRate(),
+               cache.memoryUsed(), cache.size());
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Arduino.cpp - Minimal Arduino API to build the examples on a host (Linux)
+ * against the simulator.
+ */
+#include "Arduino.h"
+
+#include "SmoothStepperHal.h"
+
+SimulatorSerial Serial;
+
+void pinMode(int pin, int) { stepperPinOutput(pin); }
+
+void digitalWrite(int pin, int value) { stepperPinWrite(pin, value); }
+
+unsigned long micros() { return simulatorClock().micros(); }
+
+unsigned long millis() { return simulatorClock().micros() / 1000; }
+
+void delay(unsigned long ms) { simulatorClock().advance(ms * 1000); }
+
+long random(long min, long max) { return min + rand() % (max - min); }
+
+void disableCore0WDT() {}
@@ -0,0 +1,50 @@
+/*
+ * Arduino.h - Minimal Arduino API to build the examples on a host (Linux)
+ * against the simulator.
+ */
+#ifndef SimulatorArduino_h
+#define SimulatorArduino_h
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Simulator.h"
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define PI 3.1415926535897932384626433832795
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+long random(long min, long max);
+void disableCore0WDT();
+
+/*
+ * Serial port printing to stdout.
+ */
+class SimulatorSerial {
+   public:
+    void begin(unsigned long) {}
+    void print(const char *text) { printf("%s", text); }
+    void print(long value) { printf("%ld", value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(int value) { printf("%d", value); }
+    void print(double value) { printf("%.2f", value); }
+    void println() { printf("\n"); }
+    template <typename T>
+    void println(T value) {
+        this->print(value);
+        this->println();
+    }
+};
+
+extern SimulatorSerial Serial;
+
+#endif
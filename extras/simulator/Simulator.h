@@ -0,0 +1,45 @@
+/*
+ * Simulator.h - Host (Linux) simulator of the SmoothStepper HAL.
+ *
+ * All the timers and tasks run on one virtual clock, the pins only record
+ * what is written to them.
+ */
+#ifndef Simulator_h
+#define Simulator_h
+
+#include "VirtualStepperTimer.h"
+
+#define SIMULATOR_PINS 64
+
+// Virtual clock of the simulator
+VirtualClock &simulatorClock();
+
+// Last value written to a pin
+int simulatorPinLevel(int pin);
+
+// Number of GPIO writes (a pin or a whole port) since the start
+unsigned long simulatorPinWrites();
+
+// STEP pulse played by a BoardPulseGenerator
+struct SimulatorPulse {
+    unsigned long date;  // us
+    int step_pin;
+    int direction;  // 1 or -1, level of the DIR pin
+};
+
+// Every pulse played since the start
+const std::vector<SimulatorPulse> &simulatorPulses();
+
+// Frame shifted out by a BoardShiftRegister
+struct SimulatorTransfer {
+    unsigned long date;  // us
+    const BoardShiftRegister *chain;
+    StepperPinMask frame;  // Outputs high once latched
+    int length;            // Bytes sent
+    uint8_t bytes[8];      // As sent, the last register first
+};
+
+// Every frame sent since the start
+const std::vector<SimulatorTransfer> &simulatorTransfers();
+
+#endif
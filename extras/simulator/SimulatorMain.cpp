@@ -0,0 +1,24 @@
+/*
+ * SimulatorMain.cpp - Runs an Arduino sketch on the simulator:
+ * setup() then loop() a given number of times (first argument, default 3).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Arduino.h"
+
+void setup();
+void loop();
+
+int main(int argc, char **argv) {
+    int loops = argc > 1 ? atoi(argv[1]) : 3;
+    srand(1);
+
+    setup();
+    for (int i = 0; i < loops; i++) {
+        loop();
+    }
+
+    printf("Simulated time: %lu ms, GPIO writes: %lu\n", millis(), simulatorPinWrites());
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * SmoothStepperHalHost.cpp - Virtual time backend of the SmoothStepper HAL
+ * for host (Linux) builds.
+ */
+#include "Simulator.h"
+#include "SmoothStepperHal.h"
+
+static int pinLevels[SIMULATOR_PINS];
+static unsigned long pinWrites = 0;
+static std::vector<SimulatorPulse> pulses;
+static std::vector<SimulatorTransfer> shiftTransfers;
+
+VirtualClock &simulatorClock() {
+    static VirtualClock clock;
+    return clock;
+}
+
+int simulatorPinLevel(int pin) { return pinLevels[pin]; }
+
+unsigned long simulatorPinWrites() { return pinWrites; }
+
+const std::vector<SimulatorPulse> &simulatorPulses() { return pulses; }
+
+const std::vector<SimulatorTransfer> &simulatorTransfers() { return shiftTransfers; }
+
+StepperClock *stepperDefaultClock() { return &simulatorClock(); }
+
+void stepperPinOutput(int) {}
+
+void stepperPinWrite(int pin, int value) {
+    pinLevels[pin] = value;
+    pinWrites++;
+}
+
+void stepperPortWrite(StepperPinMask set, StepperPinMask clear) {
+    for (StepperPinMask pins = set | clear; pins != 0; pins &= pins - 1) {
+        int pin = __builtin_ctzll(pins);
+        pinLevels[pin] = set >> pin & 1;
+    }
+    pinWrites++;  // One register write
+}
+
+void stepperStartTask(StepperTask *task, const StepperTaskConfig &) { simulatorClock().start(task); }
+
+void stepperWakeTask(StepperTask *task) { simulatorClock().wake(task); }
+
+void stepperYield() { simulatorClock().runNext(); }
+
+/*
+ * Signal on the virtual clock: waiting runs the timers and the tasks
+ * until the step loop notifies.
+ */
+StepperSignal::StepperSignal() { this->handle = new bool(false); }
+
+StepperSignal::~StepperSignal() { delete reinterpret_cast<bool *>(this->handle); }
+
+void StepperSignal::clear() { *reinterpret_cast<bool *>(this->handle) = false; }
+
+void StepperSignal::notify() { *reinterpret_cast<bool *>(this->handle) = true; }
+
+bool StepperSignal::wait(unsigned long timeout) {
+    bool *notified = reinterpret_cast<bool *>(this->handle);
+    unsigned long start = simulatorClock().micros();
+    while (!*notified) {
+        if (timeout != STEPPER_WAIT_FOREVER && simulatorClock().micros() - start >= timeout) {
+            return false;
+        }
+        simulatorClock().runNext();
+    }
+    return true;
+}
+
+/*
+ * One shot timer on the virtual clock.
+ */
+BoardStepperTimer::BoardStepperTimer() {
+    VirtualStepperTimer *timer = new VirtualStepperTimer(simulatorClock());
+    timer->attach(BoardStepperTimer::fire, this);
+    this->handle = timer;
+}
+
+BoardStepperTimer::~BoardStepperTimer() {
+    delete reinterpret_cast<VirtualStepperTimer *>(this->handle);
+}
+
+unsigned long BoardStepperTimer::micros() { return simulatorClock().micros(); }
+
+void BoardStepperTimer::attach(Callback callback, void *arg) {
+    this->callback = callback;
+    this->arg = arg;
+}
+
+void BoardStepperTimer::armAt(unsigned long date) {
+    reinterpret_cast<VirtualStepperTimer *>(this->handle)->armAt(date);
+}
+
+void BoardStepperTimer::disarm() {
+    reinterpret_cast<VirtualStepperTimer *>(this->handle)->disarm();
+}
+
+void BoardStepperTimer::fire(void *arg) {
+    BoardStepperTimer *timer = reinterpret_cast<BoardStepperTimer *>(arg);
+    if (timer->callback != nullptr) {
+        timer->callback(timer->arg);
+    }
+}
+
+/*
+ * Pulse generator on the virtual clock: a chunk is recorded at once with
+ * the dates of its pulses, a virtual timer fires at its last pulse to
+ * start the queued chunk and wake the task.
+ */
+struct HostPulseGenerator {
+    VirtualStepperTimer timer{simulatorClock()};
+    int step_pin;
+    int dir_pin;
+    StepperTask *task = nullptr;
+    uint32_t intervals[2][STEPPER_PULSE_CHUNK];
+    int counts[2];
+    int directions[2];
+    int playing = -1;  // Chunk playing, -1 for none
+    int queued = -1;   // Chunk waiting behind it
+    int fill = 0;      // Chunk given by nextChunk()
+
+    void play(int chunk) {
+        this->playing = chunk;
+        pinLevels[this->dir_pin] = this->directions[chunk] > 0;
+        unsigned long date = simulatorClock().micros();
+        for (int i = 0; i < this->counts[chunk]; i++) {
+            date += this->intervals[chunk][i];
+            SimulatorPulse pulse = {date, this->step_pin, this->directions[chunk]};
+            pulses.push_back(pulse);
+        }
+        this->timer.armAt(date);
+    }
+
+    static void done(void *arg) {
+        HostPulseGenerator *generator = reinterpret_cast<HostPulseGenerator *>(arg);
+        generator->playing = -1;
+        if (generator->queued >= 0) {
+            generator->play(generator->queued);
+            generator->queued = -1;
+        }
+        if (generator->task != nullptr) {
+            stepperWakeTask(generator->task);
+        }
+    }
+};
+
+BoardPulseGenerator::BoardPulseGenerator(int step_pin, int dir_pin) {
+    this->step_pin = step_pin;
+    this->dir_pin = dir_pin;
+}
+
+BoardPulseGenerator::~BoardPulseGenerator() {
+    delete reinterpret_cast<HostPulseGenerator *>(this->handle);
+}
+
+bool BoardPulseGenerator::begin() {
+    if (this->handle != nullptr) return true;
+    HostPulseGenerator *generator = new HostPulseGenerator();
+    generator->step_pin = this->step_pin;
+    generator->dir_pin = this->dir_pin;
+    generator->timer.attach(HostPulseGenerator::done, generator);
+    this->handle = generator;
+    return true;
+}
+
+void BoardPulseGenerator::attach(StepperTask *task) {
+    HostPulseGenerator *generator = reinterpret_cast<HostPulseGenerator *>(this->handle);
+    if (generator != nullptr) generator->task = task;
+}
+
+uint32_t *BoardPulseGenerator::nextChunk() {
+    HostPulseGenerator *generator = reinterpret_cast<HostPulseGenerator *>(this->handle);
+    if (generator == nullptr || this->pending() == 2) return nullptr;
+    return generator->intervals[generator->fill];
+}
+
+void BoardPulseGenerator::queue(int count, int direction) {
+    HostPulseGenerator *generator = reinterpret_cast<HostPulseGenerator *>(this->handle);
+    int chunk = generator->fill;
+    generator->counts[chunk] = count;
+    generator->directions[chunk] = direction;
+    generator->fill ^= 1;
+    if (generator->playing < 0) {
+        generator->play(chunk);
+    } else {
+        generator->queued = chunk;
+    }
+}
+
+int BoardPulseGenerator::pending() {
+    HostPulseGenerator *generator = reinterpret_cast<HostPulseGenerator *>(this->handle);
+    if (generator == nullptr) return 0;
+    return (generator->playing >= 0) + (generator->queued >= 0);
+}
+
+/*
+ * Shift register chain: each frame is recorded with its date instead of
+ * being sent.
+ */
+BoardShiftRegister::BoardShiftRegister(int registers, int data_pin, int clock_pin, int latch_pin,
+                                       uint32_t frequency) {
+    this->registers = registers < 1 ? 1 : registers > 8 ? 8 : registers;
+    this->data_pin = data_pin;
+    this->clock_pin = clock_pin;
+    this->latch_pin = latch_pin;
+    this->frequency = frequency;
+}
+
+BoardShiftRegister::~BoardShiftRegister() {}
+
+bool BoardShiftRegister::begin() {
+    if (this->handle != nullptr) return true;
+    this->handle = this;  // Started
+    this->send();
+    return true;
+}
+
+void BoardShiftRegister::write(StepperPinMask set, StepperPinMask clear) {
+    StepperPinMask bits = (this->bits & ~clear) | set;
+    if (bits == this->bits) return;
+    this->bits = bits;
+    if (this->handle != nullptr) this->send();  // Else sent by begin()
+}
+
+void BoardShiftRegister::send() {
+    SimulatorTransfer transfer;
+    transfer.date = simulatorClock().micros();
+    transfer.chain = this;
+    transfer.frame = this->registers < 8 ? this->bits & (((StepperPinMask)1 << (8 * this->registers)) - 1) : this->bits;
+    transfer.length = this->registers;
+    for (int i = 0; i < transfer.length && i < 8; i++) {
+        transfer.bytes[i] = this->bits >> (8 * (transfer.length - 1 - i));
+    }
+    shiftTransfers.push_back(transfer);
+    this->transfer_count++;
+}
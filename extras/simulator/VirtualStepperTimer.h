@@ -0,0 +1,167 @@
+/*
+ * VirtualStepperTimer.h - Virtual time backend of the SmoothStepper timers
+ * and tasks for host (Linux) builds.
+ *
+ * Time only moves when runUntil() is called. Timers fire and task services
+ * are called in date order and exactly at their date, so a run is fully
+ * deterministic.
+ */
+#ifndef VirtualStepperTimer_h
+#define VirtualStepperTimer_h
+
+#include <algorithm>
+#include <vector>
+
+#include "SmoothStepperHal.h"
+
+class VirtualStepperTimer;
+
+/*
+ * Virtual clock shared by all the virtual timers and tasks.
+ */
+class VirtualClock : public StepperClock {
+   public:
+    unsigned long micros() { return this->now; }
+
+    // Fire every timer and call every task due before date, in date order,
+    // then set the time to date.
+    void runUntil(unsigned long date);
+
+    // Move the time forward of duration (us)
+    void advance(unsigned long duration) { this->runUntil(this->now + duration); }
+
+    // Move the time to the next timer or task date (at most STEPPER_IDLE_POLL)
+    void runNext();
+
+    // Run the task service from now on
+    void start(StepperTask *task);
+
+    // Call the task service now instead of at the date it asked for
+    void wake(StepperTask *task);
+
+    // Number of timer callbacks and task service calls since the start
+    unsigned long dispatches() { return this->dispatch_count; }
+
+   private:
+    friend class VirtualStepperTimer;
+
+    struct Task {
+        StepperTask *task;
+        unsigned long date;  // Next call
+    };
+
+    unsigned long now = 0;
+    unsigned long dispatch_count = 0;
+    std::vector<VirtualStepperTimer *> timers;
+    std::vector<Task> tasks;
+};
+
+/*
+ * One shot timer running on a VirtualClock.
+ */
+class VirtualStepperTimer : public StepperTimer {
+   public:
+    explicit VirtualStepperTimer(VirtualClock &clock) : clock(clock) {
+        clock.timers.push_back(this);
+    }
+
+    ~VirtualStepperTimer() {
+        std::vector<VirtualStepperTimer *> &timers = this->clock.timers;
+        timers.erase(std::remove(timers.begin(), timers.end(), this), timers.end());
+    }
+
+    unsigned long micros() { return this->clock.now; }
+
+    void attach(Callback callback, void *arg) {
+        this->callback = callback;
+        this->arg = arg;
+    }
+
+    void armAt(unsigned long date) {
+        // A date in the past fires now.
+        if ((long)(date - this->clock.now) < 0) {
+            date = this->clock.now;
+        }
+        this->date = date;
+        this->armed = true;
+    }
+
+    void disarm() { this->armed = false; }
+
+   private:
+    friend class VirtualClock;
+
+    VirtualClock &clock;
+    Callback callback = nullptr;
+    void *arg = nullptr;
+    unsigned long date = 0;
+    bool armed = false;
+};
+
+inline void VirtualClock::start(StepperTask *task) {
+    Task entry = {task, this->now};
+    this->tasks.push_back(entry);
+    task->handle = task;
+}
+
+inline void VirtualClock::wake(StepperTask *task) {
+    for (Task &entry : this->tasks) {
+        if (entry.task == task) entry.date = this->now;
+    }
+}
+
+inline void VirtualClock::runUntil(unsigned long date) {
+    while (1) {
+        VirtualStepperTimer *timer = nullptr;
+        for (VirtualStepperTimer *candidate : this->timers) {
+            if (!candidate->armed || (long)(candidate->date - date) > 0) continue;
+            if (timer == nullptr || (long)(candidate->date - timer->date) < 0) {
+                timer = candidate;
+            }
+        }
+
+        Task *task = nullptr;
+        for (Task &candidate : this->tasks) {
+            if ((long)(candidate.date - date) > 0) continue;
+            if (task == nullptr || (long)(candidate.date - task->date) < 0) {
+                task = &candidate;
+            }
+        }
+
+        if (timer != nullptr && (task == nullptr || (long)(timer->date - task->date) <= 0)) {
+            this->now = timer->date;
+            this->dispatch_count++;
+            timer->armed = false;
+            if (timer->callback != nullptr) {
+                timer->callback(timer->arg);
+            }
+        } else if (task != nullptr) {
+            this->now = task->date;
+            this->dispatch_count++;
+            unsigned long next = task->task->service(task->task->arg, this->now);
+
+            // A busy task is called again 1 us later.
+            if ((long)(next - this->now) <= 0) {
+                next = this->now + 1;
+            }
+            task->date = next;
+        } else {
+            break;
+        }
+    }
+    this->now = date;
+}
+
+inline void VirtualClock::runNext() {
+    unsigned long next = this->now + STEPPER_IDLE_POLL;
+    for (VirtualStepperTimer *timer : this->timers) {
+        if (timer->armed && (long)(timer->date - next) < 0) next = timer->date;
+    }
+    for (Task &task : this->tasks) {
+        if ((long)(task.date - next) < 0) next = task.date;
+    }
+    if (next == this->now) next++;
+    this->runUntil(next);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * traceDecode.cpp - Decode a step trace (SmoothStepperTrace.h) into CSV.
+ *
+ * Reads the bytes of a StepTraceLog, raw or as the hex lines printed by
+ * examples/trace.cpp (the other lines of a serial log are skipped), and
+ * prints one CSV line per step: date, position, direction, interval,
+ * speed (step/s, or rev/min with -s) and planner state. A summary goes to
+ * stderr.
+ *
+ * Built by the CMake host build:
+ *   ./traceDecode [-s stepsPerRevolution] [trace.bin | serial.log]
+ *   ./example_trace | ./traceDecode -s 2048 > trace.csv
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "SmoothStepperTrace.h"
+
+static const char *planners[] = {"idle", "moving", "stopping", "jogging", "playing"};
+
+// Bytes of the hex lines of a text log, false when the input is not text
+static bool fromHex(const std::string &text, std::vector<uint8_t> *bytes) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+
+        while (!line.empty() && isspace((unsigned char)line.back())) line.pop_back();
+        bool hex = !line.empty() && line.size() % 2 == 0;
+        for (size_t i = 0; i < line.size() && hex; i++) {
+            if (!isxdigit((unsigned char)line[i])) hex = false;
+        }
+        if (!hex) {
+            for (size_t i = 0; i < line.size(); i++) {
+                unsigned char c = line[i];
+                if (c < 0x20 && c != '\t' && c != '\r') return false;  // Binary
+            }
+            continue;
+        }
+        for (size_t i = 0; i < line.size(); i += 2) {
+            bytes->push_back((uint8_t)strtol(line.substr(i, 2).c_str(), nullptr, 16));
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int stepsPerRevolution = 0;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            stepsPerRevolution = atoi(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    FILE *file = path != nullptr ? fopen(path, "rb") : stdin;
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    std::string input;
+    char buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) input.append(buffer, length);
+    if (file != stdin) fclose(file);
+
+    std::vector<uint8_t> bytes;
+    if (!fromHex(input, &bytes)) {
+        bytes.assign(input.begin(), input.end());
+    }
+
+    printf("dateUs,position,direction,intervalUs,%s,planner\n", stepsPerRevolution > 0 ? "speedRpm" : "speedStepsPerS");
+    StepTraceDecoder decoder;
+    StepTraceEvent event;
+    unsigned long steps = 0;
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (!decoder.feed(bytes[i], &event)) continue;
+
+        double speed = event.interval > 0 ? event.direction * 1e6 / event.interval : 0;  // step/s
+        if (stepsPerRevolution > 0) speed = speed * 60 / stepsPerRevolution;
+        printf("%lu,%ld,%d,%lu,%.3f,%s\n", event.date, event.position, event.direction,
+               (unsigned long)event.interval, speed, event.planner < 5 ? planners[event.planner] : "?");
+        steps++;
+    }
+
+    fprintf(stderr, "%lu steps, %zu bytes, %.2f bytes/step, %lu unknown records\n", steps, bytes.size(),
+            steps > 0 ? (double)bytes.size() / steps : 0, (unsigned long)decoder.errors);
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * SmoothRamp.cpp - Integer only acceleration ramp for the SmoothStepper library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothRamp.h"
+
+// Longest interval so that 2 * interval fits in 32 bits (~8.3 s)
+static const float maxInterval = 0x7FFFFFFF;
+
+static uint32_t toInterval(float speed) {
+    float interval = 256000 / speed;  // us, 24.8
+    if (interval > maxInterval) interval = maxInterval;
+    return (uint32_t)interval;
+}
+
+void SmoothRamp::configure(float vmin, float vmax, float acc) {
+    this->interval_vmin = toInterval(vmin);
+
+    if (acc <= 0 || vmax <= vmin) {  // Constant speed
+        this->interval_vmax = this->interval_vmin;
+        this->n_vmin = 0;
+        this->n_vmax = 0;
+    } else {
+        this->interval_vmax = toInterval(vmax);
+        this->n_vmin = vmin * vmin / (2 * acc) + 0.5f;
+        this->n_vmax = vmax * vmax / (2 * acc) + 0.5f;
+    }
+
+    this->reset();
+}
+
+void SmoothRamp::setSpeed(float speed) {
+    this->interval = toInterval(speed);
+    if (this->interval < this->interval_vmax) this->interval = this->interval_vmax;
+    if (this->interval > this->interval_vmin) this->interval = this->interval_vmin;
+
+    // v² = 2.acc.n and v = 1 / c: n grows as 1 / c²
+    float ratio = (float)this->interval_vmax / this->interval;
+    this->n = this->n_vmax * ratio * ratio + 0.5f;
+    if (this->n < this->n_vmin) this->n = this->n_vmin;
+    if (this->n > this->n_vmax) this->n = this->n_vmax;
+}
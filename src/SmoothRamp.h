@@ -0,0 +1,88 @@
+/*
+ * SmoothRamp.h - Integer only acceleration ramp for the SmoothStepper library.
+ *
+ * The step interval is updated incrementally at each step with the
+ * recurrence of D. Austin ("Generate stepper-motor speed profiles in real
+ * time", 2005):
+ *
+ *   accelerating: n = n + 1   c = c - 2c / (4n + 1)
+ *   deccelerating:            c = c + 2c / (4n - 1)   n = n - 1
+ *
+ * where n is the speed expressed as the number of steps needed to reach it
+ * from standstill (v² = 2.acc.n) and c the step interval. c is stored in
+ * microseconds as a 24.8 fixed point number, so a step costs a few integer
+ * operations and no FPU: it can run from an interrupt.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothRamp_h
+#define SmoothRamp_h
+
+#include <stdint.h>
+
+class SmoothRamp {
+   public:
+    /**
+     * Set the ramp (computed once, floats allowed)
+     * - vmin (step/ms)
+     * - vmax (step/ms)
+     * - acc (step/ms²), 0 for a constant speed of vmin
+     * The ramp is restarted at vmin.
+     * */
+    void configure(float vmin, float vmax, float acc);
+
+    // Go back to vmin
+    void reset() {
+        this->n = this->n_vmin;
+        this->interval = this->interval_vmin;
+    }
+
+    /**
+     * Go on from speed (step/ms) instead of vmin (computed once, floats allowed)
+     * */
+    void setSpeed(float speed);
+
+    // Compute the interval before the next step while accelerating
+    void accelerate() {
+        if (this->n >= this->n_vmax) return;
+        this->n++;
+        this->interval -= 2 * this->interval / (4 * this->n + 1);
+        if (this->interval < this->interval_vmax) this->interval = this->interval_vmax;
+    }
+
+    // Compute the interval before the next step while deccelerating
+    void deccelerate() {
+        if (this->n <= this->n_vmin) return;
+        this->interval += 2 * this->interval / (4 * this->n - 1);
+        this->n--;
+        if (this->interval > this->interval_vmin) this->interval = this->interval_vmin;
+    }
+
+    // Interval before the next step (us)
+    uint32_t intervalMicros() const { return this->interval >> 8; }
+
+    bool atVmin() const { return this->n <= this->n_vmin; }
+    bool atVmax() const { return this->n >= this->n_vmax; }
+
+    // Number of steps to go from the current speed to vmin
+    uint32_t stepsToVmin() const { return this->n - this->n_vmin; }
+
+    // Number of steps to go from the current speed to vmax
+    uint32_t stepsToVmax() const { return this->n_vmax - this->n; }
+
+    // Number of steps to go from vmax to vmin
+    uint32_t stepsVmaxToVmin() const { return this->n_vmax - this->n_vmin; }
+
+   private:
+    uint32_t n = 0;              // Current speed (steps from standstill)
+    uint32_t n_vmin = 0;         // vmin (steps from standstill)
+    uint32_t n_vmax = 0;         // vmax (steps from standstill)
+    uint32_t interval = 0;       // Current step interval (us, 24.8)
+    uint32_t interval_vmin = 0;  // Step interval at vmin (us, 24.8)
+    uint32_t interval_vmax = 0;  // Step interval at vmax (us, 24.8)
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * SmoothSCurve.cpp - Jerk limited speed ramps for the SmoothStepper library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothSCurve.h"
+
+#include <math.h>
+
+void SmoothSCurve::configure(float vmin, float vmax, float acc, float jerk) {
+    this->vmin = vmin;
+    this->vmax = vmax;
+    this->acc = acc;
+    this->jerk = jerk;
+    this->peak_speed = vmin;
+    this->start(vmin, vmin);
+}
+
+/*
+ * The acceleration reaches acc only when the speed change is large enough,
+ * otherwise the ramp is two jerk segments.
+ */
+float SmoothSCurve::peakAcceleration(float dv) const {
+    float a = sqrtf(dv * this->jerk);
+    return a < this->acc ? a : this->acc;
+}
+
+float SmoothSCurve::rampTime(float v0, float v1) const {
+    float dv = fabsf(v1 - v0);
+    if (dv == 0 || this->jerk <= 0) return 0;
+
+    float a = this->peakAcceleration(dv);
+    return dv / a + a / this->jerk;
+}
+
+long SmoothSCurve::plan(float v0, long steps) {
+    // Bisection on the peak speed: the distance grows with it.
+    float from = v0 < this->vmin ? this->vmin : (v0 > this->vmax ? this->vmax : v0);
+    float low = from;
+    float high = this->vmax;
+    if (this->rampSteps(low, high) + this->rampSteps(high, this->vmin) <= steps) {
+        low = high;
+    } else {
+        for (int i = 0; i < 16; i++) {
+            float middle = (low + high) / 2;
+            if (this->rampSteps(from, middle) + this->rampSteps(middle, this->vmin) <= steps) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+    }
+    this->peak_speed = low;
+    return (long)ceilf(this->rampSteps(low, this->vmin));
+}
+
+void SmoothSCurve::start(float v0, float v1) {
+    this->v0 = v0;
+    this->v1 = v1;
+    this->sign = v1 >= v0 ? 1 : -1;
+    this->duration = this->rampTime(v0, v1);
+    this->a = this->duration > 0 ? this->peakAcceleration(fabsf(v1 - v0)) : 0;
+    this->t1 = this->duration > 0 ? this->a / this->jerk : 0;
+}
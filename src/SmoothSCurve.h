@@ -0,0 +1,82 @@
+/*
+ * SmoothSCurve.h - Jerk limited speed ramps for the SmoothStepper library.
+ *
+ * A move is planned once as seven segments: the acceleration rises with
+ * a constant jerk, stays at its maximum, falls back to 0 (speed ramp up),
+ * the speed stays constant, then the same three segments slow down to vmin.
+ * A ramp from v0 to v1 is symmetric, so its distance is simply
+ * (v0 + v1) / 2 * duration. When the move is too short for vmax, the peak
+ * speed is lowered until both ramps fit.
+ *
+ * The speed is then evaluated from the time since the ramp started, like
+ * the linear ramp of SmoothStepper::calculateDelay(): a few compares and
+ * multiplications per step.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothSCurve_h
+#define SmoothSCurve_h
+
+class SmoothSCurve {
+   public:
+    /**
+     * Set the limits (computed once)
+     * - vmin (step/ms)
+     * - vmax (step/ms)
+     * - acc (step/ms²)
+     * - jerk (step/ms³)
+     * */
+    void configure(float vmin, float vmax, float acc, float jerk);
+
+    /**
+     * Plan a move of steps starting at speed v0 and ending at vmin through
+     * the highest speed allowed (peak()).
+     * Return the number of steps of the ramp down from the peak.
+     * */
+    long plan(float v0, long steps);
+
+    // Peak speed of the last plan() (step/ms)
+    float peak() const { return this->peak_speed; }
+
+    // Start a ramp from speed v0 to v1 (step/ms) at t = 0
+    void start(float v0, float v1);
+
+    // Speed (step/ms) t ms after start()
+    float speed(float t) const {
+        if (t >= this->duration) return this->v1;
+        if (t <= 0) return this->v0;
+        if (t < this->t1) return this->v0 + this->sign * this->jerk * t * t / 2;
+        if (t < this->duration - this->t1) return this->v0 + this->sign * this->a * (t - this->t1 / 2);
+        float left = this->duration - t;
+        return this->v1 - this->sign * this->jerk * left * left / 2;
+    }
+
+    // Duration (ms) of a ramp from v0 to v1
+    float rampTime(float v0, float v1) const;
+
+    // Number of steps of a ramp from v0 to v1
+    float rampSteps(float v0, float v1) const { return (v0 + v1) / 2 * this->rampTime(v0, v1); }
+
+   private:
+    float peakAcceleration(float dv) const;
+
+    // limits
+    float vmin = 0;
+    float vmax = 0;
+    float acc = 0;
+    float jerk = 0;
+    float peak_speed = 0;
+
+    // current ramp
+    float v0 = 0;        // Start speed (step/ms)
+    float v1 = 0;        // End speed (step/ms)
+    float sign = 1;      // 1 speeding up, -1 slowing down
+    float a = 0;         // Peak acceleration (step/ms²)
+    float t1 = 0;        // Duration of the jerk segments (ms)
+    float duration = 0;  // Duration of the ramp (ms)
+};
+
+#endif
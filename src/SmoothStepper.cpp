@@ -74,35 +74,42 @@
  */
 #include "SmoothStepper.h"
 
-#include "Arduino.h"
+#include <math.h>
+#include <stdlib.h>
 
-int SmoothStepper::numberOfTasks = 0;
+#include "SmoothStepperGroup.h"
+#include "SmoothTrajectoryCache.h"
+
+// RAM of a motor on a 32 bit board with the default settings (README)
+#if UINTPTR_MAX == 0xFFFFFFFF && SMOOTHSTEPPER_COMMAND_QUEUE_SIZE == 16 && \
+    SMOOTHSTEPPER_MOTION_QUEUE_SIZE == 8 && !SMOOTHSTEPPER_TIMING
+static_assert(sizeof(SmoothStepper) <= 672, "SmoothStepper grew, update the bytes per motor of the README");
+#endif
+
+constexpr uint8_t TwoWireSequence::phases[];
+constexpr uint8_t FourWireSequence::phases[];
+constexpr uint8_t FourWireHalfSequence::phases[];
+constexpr uint8_t FiveWireSequence::phases[];
+
+/*
+ * Motor without coil pins: a STEP/DIR motor, or a SmoothStepperMotor
+ * which sets the pins.
+ */
+SmoothStepper::SmoothStepper(int number_of_steps) {
+    this->number_of_steps = number_of_steps;  // total number of steps for this motor
+}
 
 /*
  * two-wire constructor.
  * Sets which wires should control the motor.
  */
 SmoothStepper::SmoothStepper(int number_of_steps, int motor_pin_1,
-                             int motor_pin_2) {
-    this->step_number = 0;  // which step the motor is on
-    this->number_of_steps =
-        number_of_steps;  // total number of steps for this motor
-
-    // Arduino pins for the motor control connection:
-    this->motor_pin_1 = motor_pin_1;
-    this->motor_pin_2 = motor_pin_2;
-
-    // setup the pins on the microcontroller:
-    pinMode(this->motor_pin_1, OUTPUT);
-    pinMode(this->motor_pin_2, OUTPUT);
-
-    // When there are only 2 pins, set the others to 0:
-    this->motor_pin_3 = 0;
-    this->motor_pin_4 = 0;
-    this->motor_pin_5 = 0;
-
-    // pin_count is used by the stepMotor() method:
-    this->pin_count = 2;
+                             int motor_pin_2)
+    : SmoothStepper(number_of_steps) {
+    const int pins[] = {motor_pin_1, motor_pin_2};
+    this->owned_masks = new StepperPinMask[TwoWireSequence::length];
+    this->setPins(pins, TwoWireSequence::pins, TwoWireSequence::phases,
+                  TwoWireSequence::length, TwoWireSequence::microsteps, this->owned_masks);
 }
 
 /*
@@ -111,28 +118,12 @@ SmoothStepper::SmoothStepper(int number_of_steps, int motor_pin_1,
  */
 SmoothStepper::SmoothStepper(int number_of_steps, int motor_pin_1,
                              int motor_pin_2, int motor_pin_3,
-                             int motor_pin_4) {
-    this->step_number = 0;  // which step the motor is on
-    this->number_of_steps =
-        number_of_steps;  // total number of steps for this motor
-
-    // Arduino pins for the motor control connection:
-    this->motor_pin_1 = motor_pin_1;
-    this->motor_pin_2 = motor_pin_2;
-    this->motor_pin_3 = motor_pin_3;
-    this->motor_pin_4 = motor_pin_4;
-
-    // setup the pins on the microcontroller:
-    pinMode(this->motor_pin_1, OUTPUT);
-    pinMode(this->motor_pin_2, OUTPUT);
-    pinMode(this->motor_pin_3, OUTPUT);
-    pinMode(this->motor_pin_4, OUTPUT);
-
-    // When there are 4 pins, set the others to 0:
-    this->motor_pin_5 = 0;
-
-    // pin_count is used by the stepMotor() method:
-    this->pin_count = 4;
+                             int motor_pin_4)
+    : SmoothStepper(number_of_steps) {
+    const int pins[] = {motor_pin_1, motor_pin_2, motor_pin_3, motor_pin_4};
+    this->owned_masks = new StepperPinMask[FourWireSequence::length];
+    this->setPins(pins, FourWireSequence::pins, FourWireSequence::phases,
+                  FourWireSequence::length, FourWireSequence::microsteps, this->owned_masks);
 }
 
 /*
@@ -141,108 +132,562 @@ SmoothStepper::SmoothStepper(int number_of_steps, int motor_pin_1,
  */
 SmoothStepper::SmoothStepper(int number_of_steps, int motor_pin_1,
                              int motor_pin_2, int motor_pin_3, int motor_pin_4,
-                             int motor_pin_5) {
-    this->step_number = 0;  // which step the motor is on
-    this->number_of_steps =
-        number_of_steps;  // total number of steps for this motor
-
-    // Arduino pins for the motor control connection:
-    this->motor_pin_1 = motor_pin_1;
-    this->motor_pin_2 = motor_pin_2;
-    this->motor_pin_3 = motor_pin_3;
-    this->motor_pin_4 = motor_pin_4;
-    this->motor_pin_5 = motor_pin_5;
-
-    // setup the pins on the microcontroller:
-    pinMode(this->motor_pin_1, OUTPUT);
-    pinMode(this->motor_pin_2, OUTPUT);
-    pinMode(this->motor_pin_3, OUTPUT);
-    pinMode(this->motor_pin_4, OUTPUT);
-    pinMode(this->motor_pin_5, OUTPUT);
-
-    // pin_count is used by the stepMotor() method:
-    this->pin_count = 5;
-}
-
-void SmoothStepper::begin() {
-    this->numberOfTasks++;
-    strcpy(this->task_name, "stepperTask");
-    char buffer[10];
-    sprintf(buffer, "%d", this->numberOfTasks);
-    strcat(this->task_name, buffer);
-
-    xTaskCreatePinnedToCore(
-        SmoothStepper::staticSmoothStepperTask,  // Task function.
-        this->task_name,                         // name of task.
-        2000,                                    // Stack size of task
-        this,                                    // parameter of the task
-        1,                                       // priority of the task
-        NULL,                                    // Task handle to keep track of created task
-        0);                                      // pin task to core 0
-}
-
-void SmoothStepper::staticSmoothStepperTask(void *pvParameters) {
+                             int motor_pin_5)
+    : SmoothStepper(number_of_steps) {
+    const int pins[] = {motor_pin_1, motor_pin_2, motor_pin_3, motor_pin_4, motor_pin_5};
+    this->owned_masks = new StepperPinMask[FiveWireSequence::length];
+    this->setPins(pins, FiveWireSequence::pins, FiveWireSequence::phases,
+                  FiveWireSequence::length, FiveWireSequence::microsteps, this->owned_masks);
+}
+
+/*
+ *   constructor for a custom phase table
+ *   Sets which wires should control the motor and how.
+ */
+SmoothStepper::SmoothStepper(int number_of_steps, const int *pins, int pin_count,
+                             const uint8_t *phases, int phase_count, int microsteps)
+    : SmoothStepper(number_of_steps) {
+    if (phase_count < 1 || phase_count > 255) return;  // Rejected, see setPins()
+    this->owned_masks = new StepperPinMask[phase_count];
+    this->setPins(pins, pin_count, phases, phase_count, microsteps, this->owned_masks);
+}
+
+SmoothStepper::~SmoothStepper() {
+    delete[] this->owned_masks;
+}
+
+/*
+ * Setup the pins on the microcontroller (unless they are outputs of
+ * this->output) and compile the phase sequence
+ * into masks of the motor pins, so that a step is one set and one clear write.
+ * From then on a step is a step of the sequence.
+ * A table that doesn't fit the masks (a phase is a byte of pin levels, the
+ * phase number a uint8_t, a pin a bit of StepperPinMask) is rejected: the
+ * motor keeps no pins.
+ */
+void SmoothStepper::setPins(const int *pins, int pin_count, const uint8_t *phases,
+                            int phase_count, int microsteps, StepperPinMask *masks) {
+    if (pin_count < 1 || pin_count > 8 || phase_count < 1 || phase_count > 255 || microsteps < 1) return;
+    for (int pin = 0; pin < pin_count; pin++) {
+        if (pins[pin] < 0 || pins[pin] >= 64) return;
+    }
+
+    this->number_of_steps = this->number_of_steps * microsteps;
+    this->pins_mask = 0;
+    for (int pin = 0; pin < pin_count; pin++) {
+        if (this->output == nullptr) stepperPinOutput(pins[pin]);
+        this->pins_mask |= (StepperPinMask)1 << pins[pin];
+    }
+    for (int phase = 0; phase < phase_count; phase++) {
+        masks[phase] = 0;
+        for (int pin = 0; pin < pin_count; pin++) {
+            if (phases[phase] >> (pin_count - 1 - pin) & 1) {
+                masks[phase] |= (StepperPinMask)1 << pins[pin];
+            }
+        }
+    }
+    this->phase_masks = masks;
+    this->phase_count = phase_count;
+}
+
+void SmoothStepper::begin(const StepperTaskConfig &config) {
+    this->started = true;
+    this->calculStrategy();
+
+    this->task.service = SmoothStepper::staticSmoothStepperTask;
+    this->task.arg = this;
+    this->task.name = "stepperTask";
+    stepperStartTask(&this->task, config);
+}
+
+unsigned long SmoothStepper::staticSmoothStepperTask(void *pvParameters, unsigned long now) {
     SmoothStepper *smoothStepper =
         reinterpret_cast<SmoothStepper *>(pvParameters);
-    smoothStepper->smoothStepperTask();
+    return smoothStepper->smoothStepperTask(now);
 }
 
-void SmoothStepper::smoothStepperTask() {
+/*
+ * One turn of the task loop.
+ * Return the date (us) of the next step.
+ */
+unsigned long SmoothStepper::smoothStepperTask(unsigned long now) {
+    this->poll(now);
+
+    if (this->isMoving()) {
+        return this->nextStepTime();
+    }
+    return now + STEPPER_IDLE_SLEEP;  // Or until woken by a command
+}
+
+/*
+ * Timer driven engine: each step is done by the timer callback which arms
+ * the timer again for the next step. Nothing runs while the motor is idle.
+ */
+void SmoothStepper::begin(StepperTimer *timer) {
+    this->timer = timer;
+    this->clock = timer;
+    this->timer->attach(SmoothStepper::staticTimerCallback, this);
+    this->started = true;
     this->calculStrategy();
-    unsigned long last_step_time = 0;  // time stamp in us of when the last step was taken
+    this->wakeTimer();
+}
 
-    while (1) {
-        if (this->steps_to_move != 0) {
-            this->step_to_be += this->steps_to_move;
-            this->steps_to_move = 0;
-            this->calculStrategy();
+void SmoothStepper::staticTimerCallback(void *arg) {
+    SmoothStepper *smoothStepper = reinterpret_cast<SmoothStepper *>(arg);
+    smoothStepper->timerCallback();
+}
+
+void SmoothStepper::timerCallback() {
+    this->poll(this->clock->micros());
+
+    if (this->isMoving()) {
+        this->timer->armAt(this->nextStepTime());
+        return;
+    }
+
+    // Going idle, a command sent meanwhile would not have woken us.
+    this->timer_running = false;
+    if (!this->commands.empty()) {
+        this->wakeTimer();
+    }
+}
+
+/*
+ * STEP/DIR engine: the task plans the steps as if each one was polled at
+ * its date, on the planning clock, and hands them to the generator in
+ * chunks of intervals. It sleeps while the generator plays them.
+ */
+void SmoothStepper::begin(StepperPulseGenerator *pulses, const StepperTaskConfig &config) {
+    this->pulses = pulses;
+    this->clock = &this->planning;
+    this->started = true;
+    this->calculStrategy();
+
+    this->task.service = SmoothStepper::staticPulseTask;
+    this->task.arg = this;
+    this->task.name = "stepperPulses";
+    this->pulses->attach(&this->task);
+    stepperStartTask(&this->task, config);
+}
+
+unsigned long SmoothStepper::staticPulseTask(void *pvParameters, unsigned long now) {
+    SmoothStepper *smoothStepper = reinterpret_cast<SmoothStepper *>(pvParameters);
+    return smoothStepper->pulseTask(now);
+}
+
+/*
+ * One turn of the STEP/DIR task: fill the free chunks of the generator.
+ * Woken again when a chunk is done or by a command.
+ */
+unsigned long SmoothStepper::pulseTask(unsigned long now) {
+    bool received = !this->commands.empty();
+
+    uint32_t *intervals;
+    while ((intervals = this->pulses->nextChunk()) != nullptr) {
+        int direction = 0;
+        int count = this->planChunk(intervals, &direction);
+        if (count == 0) break;
+        this->pulses->queue(count, direction);
+    }
+
+    // Arrived once the generator played the last pulse.
+    bool arrived = this->isArrived() == 0;
+    if (arrived != this->pulse_arrived) {
+        this->publish();
+    }
+    if (arrived && (!this->pulse_arrived || received)) {
+        this->notifyArrival();
+    }
+    this->pulse_arrived = arrived;
+    return now + STEPPER_IDLE_SLEEP;
+}
+
+/*
+ * Plan the next steps, at most STEPPER_PULSE_CHUNK of them or about
+ * STEPPER_PULSE_CHUNK_TIME us, all in the same direction: a step in the
+ * other direction is carried to the next chunk.
+ * Return the number of intervals written.
+ */
+int SmoothStepper::planChunk(uint32_t *intervals, int *direction) {
+    int count = 0;
+    unsigned long duration = 0;
+    if (this->carry_direction != 0) {
+        intervals[count++] = this->carry_interval;
+        *direction = this->carry_direction;
+        duration = this->carry_interval;
+        this->carry_direction = 0;
+    }
+
+    while (count < STEPPER_PULSE_CHUNK && duration < STEPPER_PULSE_CHUNK_TIME && this->isMoving()) {
+        unsigned long previous = this->last_step_time;
+        long position = this->current_step;
+        unsigned long date = this->nextStepTime();
+        this->planning.now = date;
+        if (!this->poll(date)) {
+            // New commands may have changed the interval.
+            date = this->nextStepTime();
+            this->planning.now = date;
+            if (!this->isMoving() || !this->poll(date)) break;
+        }
+
+        uint32_t interval = date - previous;
+        int stepDirection = this->current_step > position ? 1 : -1;
+        if (count > 0 && stepDirection != *direction) {
+            this->carry_interval = interval;
+            this->carry_direction = stepDirection;
+            break;
+        }
+        *direction = stepDirection;
+        intervals[count++] = interval;
+        duration += interval;
+    }
+    return count;
+}
+
+/*
+ * Arm the timer now if the timer engine is idle, or wake the task.
+ */
+void SmoothStepper::wakeTimer() {
+    if (this->group != nullptr) {
+        this->group->wake();
+        return;
+    }
+    if (this->timer == nullptr) {
+        stepperWakeTask(&this->task);
+        return;
+    }
+    if (this->timer_running) return;
+
+    this->timer_running = true;
+    this->timer->armAt(this->clock->micros());
+}
+
+/*
+ * Take the new steps into account and do a step if it's time to.
+ * Return true when a step was done.
+ */
+bool SmoothStepper::poll(unsigned long now) {
+#if SMOOTHSTEPPER_TIMING
+    bool starting = this->direction == 0;  // No previous step to compare with
+#endif
+    Command command;
+    bool received = false;
+    while (this->commands.peek(0, &command)) {
+        // Queued moves wait in the command queue while the motion queue is full.
+        if (command.type == MOVE_QUEUED && this->segments.size() == SMOOTHSTEPPER_MOTION_QUEUE_SIZE) break;
+
+        this->commands.pop(&command);
+        this->applyCommand(command);
+        received = true;
+    }
+    if (received && this->trajectory == nullptr && !this->jogging) {
+        this->planSegments();
+        this->calculStrategy();
+    }
+    if (this->jogging && this->direction == 0) {
+        this->startJog();
+    }
+    if (received) {
+        this->publish();
+    }
+
+    if (this->step_to_be == this->current_step && this->direction == 0) {
+        if (received && this->pulses == nullptr && this->isArrived() == 0) {  // Nothing to do, like a stop at standstill
+            this->notifyArrival();
+        }
+        return false;
+    }
+    if (now - this->last_step_time < this->step_interval) {
+        return false;
+    }
+
+    this->doStep();
+#if SMOOTHSTEPPER_TIMING
+    this->recordTiming(starting);
+#endif
+    if (this->trace != nullptr) this->trace->step(now, this->direction, this->current_step);
+    this->last_step_time = now;
+
+    if (this->trajectory != nullptr) {  // A table walk instead of the ramp
+        this->trajectoryStep();
+    } else if (this->jogging) {
+        this->jogStep();
+    } else {
+        if (this->current_step == this->segment_end && !this->segments.empty()) {
+            if (this->planSegments()) {
+                this->calculStrategy();
+            }
         }
 
-        unsigned long now = micros();
-
-        if (this->step_to_be != this->current_step || this->direction != 0) {
-            if (now - last_step_time >= this->newDelay * 1000) {
-                this->doStep();
-                last_step_time = now;
-
-                if (this->stopping) {
-                    if ((this->newSpeed == this->vmin) ||
-                        (!this->smoothActivated && this->step_to_be == this->current_step)) {
-                        this->direction = 0;
-                        this->calculStrategy();
-                    } else {
-                        this->newDelay = this->calculateDelay();
-                    }
-                } else {
-                    if (this->current_step * this->direction >= this->deccelerationAtStep * this->direction) {
-                        this->stopping = true;
-                        this->start_time = this->calculateStartTime();
-                    }
-                    this->newDelay = this->calculateDelay();
+        if (this->stopping) {
+            if (this->isAtVmin() ||
+                (!this->smoothActivated && this->step_to_be == this->current_step)) {
+                this->direction = 0;
+                this->calculStrategy();
+            } else {
+                this->updateDelay();
+            }
+        } else {
+            if (this->current_step * this->direction >= this->deccelerationAtStep * this->direction) {
+                this->stopping = true;
+                if (this->rampBackend == RAMP_FLOAT) {
+                    this->start_time = this->calculateStartTime();
                 }
             }
+            this->updateDelay();
         }
     }
+
+    this->publish();
+    if (this->pulses == nullptr && this->isArrived() == 0) {  // STEP/DIR: pulseTask() knows
+        this->notifyArrival();
+    }
+    return true;
+}
+
+/*
+ * Publish the state for snapshot(), from the step loop: the sequence is
+ * odd while it is written.
+ */
+void SmoothStepper::publish() {
+    uint32_t sequence = this->published_sequence.load(std::memory_order_relaxed);
+    this->published_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint8_t planner = PLANNER_MOVING;
+    if (this->trajectory != nullptr) {
+        planner = PLANNER_PLAYING;
+    } else if (this->jogging) {
+        planner = PLANNER_JOGGING;
+    } else if (this->direction == 0) {
+        planner = PLANNER_IDLE;
+    } else if (this->stopping) {
+        planner = PLANNER_STOPPING;
+    }
+    this->published.position = this->current_step;
+    this->published.target = this->step_to_be;
+    this->published.interval = this->step_interval;
+    this->published.direction = this->direction;
+    this->published.phase = this->phase;
+    this->published.planner = planner;
+    if (this->trace != nullptr) this->trace->planner(planner);
+    this->published.arrived = this->isArrived() == 0;
+    this->published.last_step = this->last_step_time;
+
+    this->published_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/*
+ * Copy the published state, again when the step loop wrote it meanwhile.
+ */
+SmoothStepper::State SmoothStepper::snapshot() {
+    Published copy;
+    uint32_t before, after;
+    do {
+        before = this->published_sequence.load(std::memory_order_acquire);
+        copy.position = this->published.position;
+        copy.target = this->published.target;
+        copy.interval = this->published.interval;
+        copy.direction = this->published.direction;
+        copy.phase = this->published.phase;
+        copy.planner = this->published.planner;
+        copy.arrived = this->published.arrived;
+        copy.last_step = this->published.last_step;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = this->published_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    State state;
+    state.position = copy.position;
+    state.target = copy.target;
+    state.speed = 0;
+    if (copy.direction != 0 && copy.interval > 0) {
+        state.speed = copy.direction * 60000000.0f / copy.interval / this->number_of_steps;  // rev/min
+    }
+    state.direction = copy.direction;
+    state.phase = copy.phase;
+    state.planner = (Planner)copy.planner;
+    state.arrived = copy.arrived;
+    state.last_step = copy.last_step;
+    return state;
+}
+
+/*
+ * Wake the tasks waiting for the arrival and call the arrival callback.
+ */
+void SmoothStepper::notifyArrival() {
+    this->arrival.notify();
+    if (this->arrivalCallback != nullptr) {
+        this->arrivalCallback(this, this->arrivalArg);
+    }
+}
+
+#if SMOOTHSTEPPER_TIMING
+/*
+ * Record the timing of the step just done, before the next one is planned.
+ */
+void SmoothStepper::recordTiming(bool starting) {
+    unsigned long now = this->clock->micros();
+    if (!starting) {
+        this->timing.record(this->step_interval, now - this->timing_last_step,
+                            (long)(now - (this->last_step_time + this->step_interval)));
+    }
+    this->timing_last_step = now;
+}
+
+StepTimingLog *SmoothStepper::timingLog() { return &this->timing; }
+#endif
+
+/*
+ * Return true while there are steps to do.
+ */
+bool SmoothStepper::isMoving() {
+    return this->step_to_be != this->current_step || this->direction != 0 ||
+           this->jogging || !this->commands.empty();
+}
+
+/*
+ * Return the time (us) of the next step.
+ */
+unsigned long SmoothStepper::nextStepTime() {
+    return this->last_step_time + this->step_interval;
 }
 
 void SmoothStepper::doStep() {
     this->current_speed = this->newSpeed;
     if (this->direction == 1) {
-        this->step_number++;
         this->current_step++;
-        if (this->step_number == this->number_of_steps) {
-            this->step_number = 0;
+        if (++this->phase == this->phase_count) {
+            this->phase = 0;
         }
     } else {
-        if (this->step_number == 0) {
-            this->step_number = this->number_of_steps;
+        if (this->phase == 0) {
+            this->phase = this->phase_count;
         }
-        this->step_number--;
+        this->phase--;
         this->current_step--;
     }
 
-    // step the motor to step number 0, 1, ..., {3 or 10}
-    this->stepMotor(this->step_number % this->pin_count);
+    // step the motor to phase 0, 1, ..., phase_count - 1
+    if (this->phase_masks != nullptr) {  // Else a pulse generator steps, or it is only planned
+        this->stepMotor(this->phase);
+    }
+}
+
+/*
+ * Compute the delay before the next step, after a step.
+ */
+void SmoothStepper::updateDelay() {
+    if (this->rampBackend == RAMP_FIXED) {
+        if (this->stopping) {
+            this->ramp.deccelerate();
+        } else {
+            this->ramp.accelerate();
+        }
+        this->step_interval = this->ramp.intervalMicros();
+        return;
+    }
+    if (this->rampBackend == RAMP_EXACT && this->smoothActivated) {
+        // Constant acceleration over the step: its time is 2 / (v1 + v2)
+        float speed = this->exactSpeed(this->current_step + this->direction);
+        this->newDelay = 2 / (this->newSpeed + speed);
+        this->step_interval = this->newDelay * 1000;
+        this->previousSpeed = this->newSpeed;
+        this->newSpeed = speed;
+        return;
+    }
+
+    this->newDelay = this->calculateDelay();
+    this->step_interval = this->newDelay * 1000;
+}
+
+/*
+ * Compute the delay before the next step from the current speed,
+ * after a change of strategy.
+ */
+void SmoothStepper::restartDelay() {
+    if (this->rampBackend == RAMP_FIXED) {
+        this->step_interval = this->ramp.intervalMicros();
+        return;
+    }
+    if (this->rampBackend == RAMP_EXACT && this->smoothActivated) {
+        float speed = this->current_speed;
+        if (speed < this->vmin) speed = this->vmin;
+        if (speed > this->vmax) speed = this->vmax;
+        this->exact_origin = this->current_step;
+        this->exact_speed2 = speed * speed;
+        this->exact_end = this->step_to_be;
+        this->exact_drift = this->trackDrift();
+        this->exact_end_speed2 = this->exact_drift > this->vmin ? this->exact_drift * this->exact_drift
+                                                                : this->vmin * this->vmin;
+
+        // Too close to slow down on the target: past it, and come back.
+        float brake = (this->exact_speed2 - this->exact_end_speed2) / (2 * this->acc);  // steps
+        if (this->exactLeft(this->current_step) < brake) {
+            this->exact_end = this->current_step + this->direction * (long)ceil(brake);
+            this->exact_drift = 0;
+        }
+        this->newSpeed = speed;
+        this->updateDelay();
+        return;
+    }
+
+    this->start_time = this->calculateStartTime();
+    this->newDelay = this->calculateDelay();
+    this->step_interval = this->newDelay * 1000;
+}
+
+/*
+ * Return true when the speed is back to vmin.
+ */
+bool SmoothStepper::isAtVmin() {
+    if (this->rampBackend == RAMP_FIXED) {
+        return this->smoothActivated && this->ramp.atVmin();
+    }
+    return this->newSpeed == this->vmin;
+}
+
+/*
+ * Speed (step/ms) at a position of the move planned for RAMP_EXACT, in
+ * step units (v² = v0² + 2.acc.steps): the lowest of the acceleration
+ * from exact_origin, vmax and the decceleration to the end speed on
+ * exact_end (vmin, or the speed of a tracked target).
+ */
+float SmoothStepper::exactSpeed(long position) {
+    float done = (position - this->exact_origin) * this->direction;
+    float left = this->exactLeft(position);
+    float vmin2 = this->vmin * this->vmin;
+    float vmax2 = this->vmax * this->vmax;
+
+    // Past exact_end it goes on deccelerating to vmin
+    float speed2 = this->exact_speed2 + 2 * this->acc * done;
+    if (speed2 > vmax2) speed2 = vmax2;
+    if (speed2 > this->exact_end_speed2 + 2 * this->acc * left) speed2 = this->exact_end_speed2 + 2 * this->acc * left;
+    if (speed2 <= vmin2) return this->vmin;
+    return sqrt(speed2);
+}
+
+/*
+ * Steps from a position to exact_end, which a tracked target drives on
+ * since its last update (at most SMOOTHSTEPPER_TRACK_TIMEOUT).
+ */
+float SmoothStepper::exactLeft(long position) {
+    float left = (this->exact_end - position) * this->direction;
+    if (this->exact_drift > 0) {
+        unsigned long elapsed = this->clock->micros() - this->track_date;
+        if (elapsed > SMOOTHSTEPPER_TRACK_TIMEOUT) elapsed = SMOOTHSTEPPER_TRACK_TIMEOUT;
+        left += this->exact_drift * elapsed / 1000;
+    }
+    return left;
+}
+
+/*
+ * Speed (step/ms) of the tracked target away from the motor, 0 when it
+ * is not tracking or the target comes back.
+ */
+float SmoothStepper::trackDrift() {
+    float speed = this->track_speed * this->direction;
+    return this->tracking && speed > 0 ? speed : 0;
 }
 
 float SmoothStepper::calculateDelay() {
@@ -250,11 +695,12 @@ float SmoothStepper::calculateDelay() {
         return 1 / this->vmin;
     }
 
-    this->newDelay_last = this->newDelay;
     this->previousSpeed = this->newSpeed;
-    double ti = micros() / 1000 - this->start_time / 1000;
+    double ti = this->clock->micros() / 1000 - this->start_time / 1000;
 
-    if (this->stopping) {
+    if (this->isSCurve()) {
+        this->newSpeed = this->scurve.speed(ti);
+    } else if (this->stopping) {
         this->newSpeed = -this->acc * ti + this->vmax;
     } else {
         this->newSpeed = this->acc * ti + this->vmin;
@@ -269,7 +715,7 @@ float SmoothStepper::calculateDelay() {
 void SmoothStepper::calculStrategy() {
     int stepToMove = this->step_to_be - this->current_step;
 
-    if (stepToMove == 0 && this->newSpeed == this->vmin) {
+    if (stepToMove == 0 && this->isAtVmin()) {
         return;
     } else if (stepToMove > 0 &&
                (this->direction == 0 || !this->smoothActivated)) {  // We are stopped and will move forward.
@@ -279,33 +725,72 @@ void SmoothStepper::calculStrategy() {
         this->direction = -1;
     } else if ((stepToMove > 0 && this->direction == 1) ||
                (stepToMove < 0 && this->direction == -1)) {  // We will move more in the same direction.
-    } else {                                                 // We will stop
+    } else if (!this->smoothActivated) {                     // No ramp, we stop right here.
+        this->direction = 0;
+        return;
+    } else {  // We will stop
         this->stopping = true;
-        this->start_time = this->calculateStartTime();
-        this->newDelay = this->calculateDelay();
+        this->restartDelay();
         return;
     }
 
     if (!this->smoothActivated) {
         if (this->direction == 1) this->deccelerationAtStep = this->current_step + stepToMove - 1;
         if (this->direction == -1) this->deccelerationAtStep = this->current_step - stepToMove + 1;
+    } else if (this->isSCurve()) {  // The whole move is planned at once
+        int stepToStop = this->scurve.plan(this->current_speed, abs(stepToMove)) + 1;
+        if (abs(stepToMove) <= stepToStop) {  // stopping right now
+            this->deccelerationAtStep = this->current_step;
+            this->stopping = true;
+        } else {
+            this->stopping = false;
+            this->deccelerationAtStep = this->step_to_be - this->direction * (stepToStop + 1);
+        }
+    } else if (this->rampBackend == RAMP_EXACT) {  // The trapezoid (or triangle) in steps
+        float speed = this->current_speed;
+        if (speed < this->vmin) speed = this->vmin;
+        if (speed > this->vmax) speed = this->vmax;
+        float drift = this->trackDrift();
+        float end2 = drift > this->vmin ? drift * drift : this->vmin * this->vmin;
+        float brake = (speed * speed - end2) / (2 * this->acc);  // steps to the end speed
+        if (abs(stepToMove) < brake) {                            // stopping right now
+            this->deccelerationAtStep = this->current_step;
+            this->stopping = true;
+        } else {
+            // Where the acceleration and the decceleration meet, or vmax
+            float peak2 = (speed * speed + end2) / 2 + this->acc * abs(stepToMove);
+            if (peak2 > this->vmax * this->vmax) peak2 = this->vmax * this->vmax;
+            long decceleration = ceil((peak2 - end2) / (2 * this->acc));  // steps
+            if (decceleration < 1) decceleration = 1;
+            this->deccelerationAtStep = this->step_to_be - this->direction * decceleration;
+            // Set before the last step, which must find it
+            this->stopping = this->deccelerationAtStep * this->direction <= this->current_step * this->direction;
+        }
     } else {
-        float timeToVmin = (this->vmin - this->current_speed) / -this->acc;                           // ms
-        float timeToVmax = (this->vmax - this->current_speed) / this->acc;                            // ms
-        int stepToVmin = -this->acc / 2 * pow(timeToVmin, 2) + this->current_speed * timeToVmin + 1;  // number of steps
-        int stepToVmax = this->acc / 2 * pow(timeToVmax, 2) + this->current_speed * timeToVmax + 1;   // number of steps
+        int stepToVmin, stepToVmax, stepVmaxToVmin;
+        if (this->rampBackend == RAMP_FIXED) {  // the ramp knows them exactly
+            stepToVmin = this->ramp.stepsToVmin() + 1;
+            stepToVmax = this->ramp.stepsToVmax() + 1;
+            stepVmaxToVmin = this->ramp.stepsVmaxToVmin() + 1;
+        } else {
+            float timeToVmin = (this->vmin - this->current_speed) / -this->acc;                       // ms
+            float timeToVmax = (this->vmax - this->current_speed) / this->acc;                        // ms
+            stepToVmin = -this->acc / 2 * pow(timeToVmin, 2) + this->current_speed * timeToVmin + 1;  // number of steps
+            stepToVmax = this->acc / 2 * pow(timeToVmax, 2) + this->current_speed * timeToVmax + 1;   // number of steps
+            stepVmaxToVmin = this->stepVmaxToVmin;
+        }
         if (abs(stepToMove) <= abs(stepToVmin)) {                                                     // stopping right now
             this->deccelerationAtStep = this->current_step;
             this->stopping = true;
         } else {  // We accelerate
             this->stopping = false;
-            int cases = abs(stepToMove) - abs(stepToVmax) - abs(this->stepVmaxToVmin);
+            int cases = abs(stepToMove) - abs(stepToVmax) - abs(stepVmaxToVmin);
             if (cases == 0) {  // Go to vmax and then stopping.
                 if (this->direction == 1) this->deccelerationAtStep = this->current_step + stepToVmax - 1;
                 if (this->direction == -1) this->deccelerationAtStep = this->current_step - stepToVmax + 1;
             } else if (cases > 0) {  // constant speed for a while.
-                if (this->direction == 1) this->deccelerationAtStep = this->step_to_be - this->stepVmaxToVmin - 1;
-                if (this->direction == -1) this->deccelerationAtStep = this->step_to_be + this->stepVmaxToVmin + 1;
+                if (this->direction == 1) this->deccelerationAtStep = this->step_to_be - stepVmaxToVmin - 1;
+                if (this->direction == -1) this->deccelerationAtStep = this->step_to_be + stepVmaxToVmin + 1;
             } else {  // We will deccelerate before reach vmax.
                 this->deccelerationAtStep = abs((abs(stepToMove) - abs(stepToVmin)) / 2);
                 if (this->direction == 1) this->deccelerationAtStep = this->current_step + this->deccelerationAtStep;
@@ -313,8 +798,7 @@ void SmoothStepper::calculStrategy() {
             }
         }
     }
-    this->start_time = this->calculateStartTime();
-    this->newDelay = this->calculateDelay();
+    this->restartDelay();
 }
 
 /**
@@ -327,6 +811,11 @@ double SmoothStepper::calculateStartTime() {
     if (this->newSpeed == 0)
         this->newSpeed = this->vmin;
 
+    if (this->isSCurve()) {  // The ramp starts from the current speed
+        this->scurve.start(this->newSpeed, this->stopping ? this->vmin : this->scurve.peak());
+        return this->clock->micros();
+    }
+
     if (this->stopping) {
         t_current = (this->newSpeed - this->vmax) / -this->acc + 1 / this->previousSpeed;
     } else {
@@ -337,15 +826,44 @@ double SmoothStepper::calculateStartTime() {
         t_current = 0;
     }
 
-    return micros() - t_current * 1000;
+    return this->clock->micros() - t_current * 1000;
+}
+
+/*
+ * Return true when the ramps are S-curves.
+ */
+bool SmoothStepper::isSCurve() {
+    return this->jerkTime > 0 && this->smoothActivated && this->rampBackend == RAMP_FLOAT;
+}
+
+bool SmoothStepper::setJerk(long jerkTime) {
+    if (jerkTime < 0) {
+        return false;
+    }
+
+    Command command = {SET_JERK, jerkTime, 0, 0};
+    if (!this->sendCommand(command)) {
+        return false;
+    }
+    this->profile.jerkTime = jerkTime;
+    return true;
+}
+
+/*
+ * Select how the speed ramp is computed, to call before begin().
+ */
+void SmoothStepper::setRampBackend(RampBackend backend) {
+    this->rampBackend = backend;
+    this->ramp.reset();
 }
 
 /*
  * Return 1 when it's arrived and 0 when it's not.
  */
 int SmoothStepper::isArrived() {
-    if (this->step_to_be == this->current_step &&
-        this->direction == 0 && this->steps_to_move == 0) {
+    if (this->step_to_be == this->current_step && this->direction == 0 &&
+        this->commands.empty() && this->segments.empty() && this->carry_direction == 0 && !this->jogging &&
+        (this->pulses == nullptr || this->pulses->pending() == 0)) {
         return 0;
     } else {
         return 1;
@@ -353,17 +871,35 @@ int SmoothStepper::isArrived() {
 }
 
 /*
- * Wait until it reachs his final step
+ * Wait until it reachs his final step, at most timeout (ms).
  */
-void SmoothStepper::waitUntilArrived() {
-    while (this->isArrived()) {
+bool SmoothStepper::waitUntilArrived(unsigned long timeout) {
+    StepperTimeout left(this->pulses != nullptr ? stepperDefaultClock() : this->clock, timeout);
+    while (1) {
+        this->arrival.clear();
+        if (this->isArrived() == 0) {
+            return true;
+        }
+
+        unsigned long wait = left.next();  // us
+        if (wait == 0) {
+            return false;
+        }
+        this->arrival.wait(wait);
     }
 }
 
+void SmoothStepper::onArrival(ArrivalCallback callback, void *arg) {
+    this->arrivalCallback = callback;
+    this->arrivalArg = arg;
+}
+
 /*
- * Return the step number
+ * Return the step number within the rotation
  */
-int SmoothStepper::whatStepNumber() { return this->current_step % 2048; }
+int SmoothStepper::whatStepNumber() { return this->current_step % this->number_of_steps; }
+
+bool SmoothStepper::hasPins() { return this->phase_masks != nullptr; }
 
 /*
  * Return the number of rotation
@@ -375,25 +911,18 @@ int SmoothStepper::whatRotationNumber() {
 /*
  * Return to the origin point.
  */
-void SmoothStepper::goToOrigin(bool rotation_included) {
-    if (rotation_included) {
-        this->steps_to_move -= this->current_step;
-
-    } else {
-        this->steps_to_move -= this->current_step % 2048;
-    }
+bool SmoothStepper::goToOrigin(bool rotation_included) {
+    Command command = {GO_TO_ORIGIN, rotation_included, 0, 0};
+    return this->sendCommand(command);
 }
 
-void SmoothStepper::accelerationDisable(float speed) {
-    this->smoothActivated = false;
-    if (speed == 0) {
-        this->vmin = 0.1;
-
-    } else {
-        this->vmin = speed * this->number_of_steps / 60 / 1000;  // step/ms
+bool SmoothStepper::accelerationDisable(float speed) {
+    Command command = {SET_SPEED, 0, speed, 0};
+    if (!this->sendCommand(command)) {
+        return false;
     }
-    this->current_speed = this->vmin;
-    this->acc = 0;  // step/ms²
+    this->profile = {speed, 0, 0, this->profile.jerkTime};
+    return true;
 }
 
 /*
@@ -402,11 +931,38 @@ void SmoothStepper::accelerationDisable(float speed) {
  */
 bool SmoothStepper::accelerationEnable(float minSpeed, float maxSpeed,
                                        long rampTime) {
-    this->smoothActivated = true;
     if (maxSpeed <= 0 || rampTime <= 0 || minSpeed <= 0) {
         return false;
     }
 
+    Command command = {SET_SPEED, rampTime, minSpeed, maxSpeed};
+    if (!this->sendCommand(command)) {
+        return false;
+    }
+    this->profile = {minSpeed, maxSpeed, rampTime, this->profile.jerkTime};
+    return true;
+}
+
+/*
+ * Set the speeds, from the step loop.
+ * No rampTime means no acceleration at minSpeed.
+ */
+void SmoothStepper::setSpeed(float minSpeed, float maxSpeed, long rampTime) {
+    if (rampTime == 0) {
+        this->smoothActivated = false;
+        if (minSpeed == 0) {
+            this->vmin = 0.1;
+
+        } else {
+            this->vmin = minSpeed * this->number_of_steps / 60 / 1000;  // step/ms
+        }
+        this->current_speed = this->vmin;
+        this->acc = 0;  // step/ms²
+        this->ramp.configure(this->vmin, this->vmin, 0);
+        return;
+    }
+
+    this->smoothActivated = true;
     this->vmin = minSpeed * this->number_of_steps / 60 / 1000;  // step/ms
     this->vmax = maxSpeed * this->number_of_steps / 60 / 1000;  // step/ms
 
@@ -421,165 +977,422 @@ bool SmoothStepper::accelerationEnable(float minSpeed, float maxSpeed,
 
     this->acc = (this->vmax - this->vmin) / rampTime;                                      // step/ms²
     this->stepVmaxToVmin = -this->acc / 2 * pow(rampTime, 2) + this->vmax * rampTime + 1;  // steps
-
-    return true;
+    this->ramp.configure(this->vmin, this->vmax, this->acc);
+    this->scurve.configure(this->vmin, this->vmax, this->acc,
+                           this->jerkTime > 0 ? this->acc / this->jerkTime : 0);  // step/ms³
 }
 
 /*
  * Moves the motor forward or backwards.
  */
 void SmoothStepper::stepMotor(int thisStep) {
-    if (this->pin_count == 2) {
-        switch (thisStep) {
-            case 0:  // 01
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                break;
-            case 1:  // 11
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, HIGH);
-                break;
-            case 2:  // 10
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                break;
-            case 3:  // 00
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, LOW);
-                break;
-        }
-    }
-    if (this->pin_count == 4) {
-        switch (thisStep) {
-            case 0:  // 1010
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                break;
-            case 1:  // 0110
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                break;
-            case 2:  // 0101
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                break;
-            case 3:  // 1001
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                break;
-        }
+    StepperPinMask set = this->phase_masks[thisStep];
+    StepperPinMask clear = this->pins_mask & ~set;
+
+    this->writePins(set, clear);
+}
+
+/*
+ * Write the motor pins: with the other motors of the group, to the output
+ * or to the GPIO.
+ */
+void SmoothStepper::writePins(StepperPinMask set, StepperPinMask clear) {
+    if (this->batch != nullptr) {  // Written with the other motors of the group
+        this->batch->add(set, clear);
+    } else if (this->output != nullptr) {
+        this->output->write(set, clear);
+    } else {
+        stepperPortWrite(set, clear);
     }
+}
 
-    if (this->pin_count == 5) {
-        switch (thisStep) {
-            case 0:  // 01101
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                digitalWrite(motor_pin_5, HIGH);
-                break;
-            case 1:  // 01001
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, LOW);
-                digitalWrite(motor_pin_5, HIGH);
-                break;
-            case 2:  // 01011
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                digitalWrite(motor_pin_5, HIGH);
-                break;
-            case 3:  // 01010
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                digitalWrite(motor_pin_5, LOW);
-                break;
-            case 4:  // 11010
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, HIGH);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                digitalWrite(motor_pin_5, LOW);
-                break;
-            case 5:  // 10010
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, LOW);
-                digitalWrite(motor_pin_4, HIGH);
-                digitalWrite(motor_pin_5, LOW);
-                break;
-            case 6:  // 10110
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, HIGH);
-                digitalWrite(motor_pin_5, LOW);
-                break;
-            case 7:  // 10100
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                digitalWrite(motor_pin_5, LOW);
-                break;
-            case 8:  // 10101
-                digitalWrite(motor_pin_1, HIGH);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                digitalWrite(motor_pin_5, HIGH);
-                break;
-            case 9:  // 00101
-                digitalWrite(motor_pin_1, LOW);
-                digitalWrite(motor_pin_2, LOW);
-                digitalWrite(motor_pin_3, HIGH);
-                digitalWrite(motor_pin_4, LOW);
-                digitalWrite(motor_pin_5, HIGH);
-                break;
-        }
+/*
+ * Energize the coils at the current phase, or write all the motor pins low.
+ */
+void SmoothStepper::hold(bool holding) {
+    if (this->phase_masks == nullptr) return;  // STEP/DIR: no coil pins
+    if (holding) {
+        this->stepMotor(this->phase);
+    } else {
+        this->writePins(0, this->pins_mask);
     }
 }
 
 /*
- * Moves the motor steps_to_move steps.  If the number is negative,
+ * Moves the motor number_of_steps steps.  If the number is negative,
  * the motor moves in the reverse direction.
  */
-void SmoothStepper::step(int number_of_steps) {
-    this->steps_to_move += number_of_steps;
+bool SmoothStepper::step(int number_of_steps) {
+    Command command = {MOVE_RELATIVE, number_of_steps, 0, 0};
+    return this->sendCommand(command);
 }
 
 /*
  * Moves the motor to the absolute position.
  */
-void SmoothStepper::absolutePosition(int number_of_steps) {
-    this->step_to_be = number_of_steps - 1;
-    this->steps_to_move += 1;
+bool SmoothStepper::absolutePosition(int number_of_steps) {
+    Command command = {MOVE_ABSOLUTE, number_of_steps, 0, 0};
+    return this->sendCommand(command);
+}
+
+/*
+ * Queue a relative move after the current target and the moves already queued.
+ */
+bool SmoothStepper::queueMove(int number_of_steps) {
+    Command command = {MOVE_QUEUED, number_of_steps, 0, 0};
+    return this->sendCommand(command);
+}
+
+/*
+ * Number of queued moves the planner looks at.
+ */
+void SmoothStepper::setLookAhead(int moves) {
+    if (moves < 1) moves = 1;
+    if (moves > SMOOTHSTEPPER_MOTION_QUEUE_SIZE) moves = SMOOTHSTEPPER_MOTION_QUEUE_SIZE;
+    this->lookAhead = moves;
+}
+
+/*
+ * Drop the queued moves which are done and aim at the end of the next moves
+ * in the same direction within the look ahead: the speed is carried from
+ * one move to the next, the ramp only deccelerates for the distance left.
+ * Return true when the target changed.
+ */
+bool SmoothStepper::planSegments() {
+    long steps;
+    while (this->segments.peek(0, &steps) &&
+           (steps >= 0 ? this->current_step >= this->segment_start + steps
+                       : this->current_step <= this->segment_start + steps)) {
+        this->segment_start += steps;
+        this->segments.pop(&steps);
+    }
+    if (!this->segments.peek(0, &steps)) {
+        return false;
+    }
+    this->segment_end = this->segment_start + steps;
+
+    long target = this->segment_start;
+    int direction = 0;
+    for (int i = 0; i < this->lookAhead && this->segments.peek(i, &steps); i++) {
+        int segment_direction = steps > 0 ? 1 : -1;
+        if (direction != 0 && segment_direction != direction) break;  // We will have to stop there.
+        direction = segment_direction;
+        target += steps;
+    }
+
+    if (target == this->step_to_be) {
+        return false;
+    }
+    this->step_to_be = target;
+    return true;
 }
 
 // Wait until arrived and set origin to current position
 void SmoothStepper::setOrigin() {
     this->waitUntilArrived();
-    this->current_step = 0;
+
+    Command command = {SET_ORIGIN, 0, 0, 0};
+    while (!this->sendCommand(command)) {
+        stepperYield();
+    }
+    this->waitUntilArrived();
 }
 
 // Stop to move
-void SmoothStepper::stopMove() {
-    this->step_to_be = this->current_step - 1;
-    this->steps_to_move += 1;
+bool SmoothStepper::stopMove() {
+    Command command = {STOP, 0, 0, 0};
+    return this->sendCommand(command);
+}
+
+/*
+ * Give a command to the step loop.
+ * Return false when the command queue is full.
+ */
+bool SmoothStepper::sendCommand(const Command &command) {
+    if (!this->started) {  // No step loop yet, nothing to race with
+        this->applyCommand(command);
+        return true;
+    }
+
+    if (!this->commands.push(command)) {
+        return false;
+    }
+    this->wakeTimer();
+    return true;
+}
+
+/*
+ * Execute a command, from the step loop.
+ */
+void SmoothStepper::applyCommand(const Command &command) {
+    if (this->trajectory != nullptr) {  // The planner takes over
+        this->leaveTrajectory();
+    }
+
+    // A direct move replaces the queued moves.
+    if (command.type == MOVE_RELATIVE || command.type == MOVE_ABSOLUTE ||
+        command.type == STOP || command.type == GO_TO_ORIGIN || command.type == RUN_SPEED ||
+        command.type == TRACK_POSITION) {
+        this->segments.clear();
+    }
+
+    // Any other move ends the tracking.
+    if (this->tracking && command.type != TRACK_POSITION && command.type != SET_SPEED &&
+        command.type != SET_JERK && command.type != SET_ORIGIN) {
+        this->tracking = false;
+    }
+
+    // A move ends the jog, the planner takes over.
+    if (this->jogging && command.type != RUN_SPEED && command.type != SET_SPEED &&
+        command.type != SET_JERK && command.type != SET_ORIGIN) {
+        this->jogging = false;
+        this->resumeRamp();
+    }
+
+    switch (command.type) {
+        case MOVE_RELATIVE:
+            this->step_to_be += command.value;
+            break;
+        case MOVE_ABSOLUTE:
+            this->step_to_be = command.value;
+            break;
+        case MOVE_QUEUED:
+            if (this->segments.empty()) {  // Chain after the current target
+                this->segment_start = this->step_to_be;
+            }
+            this->segments.push(command.value);
+            break;
+        case STOP:
+            this->step_to_be = this->current_step;
+            break;
+        case GO_TO_ORIGIN:
+            if (command.value) {  // rotation included
+                this->step_to_be = 0;
+            } else {
+                this->step_to_be = this->current_step - this->current_step % this->number_of_steps;
+            }
+            break;
+        case SET_ORIGIN:
+            this->step_to_be -= this->current_step;
+            this->segment_start -= this->current_step;
+            this->segment_end -= this->current_step;
+            this->current_step = 0;
+            break;
+        case SET_SPEED:
+            this->setSpeed(command.minSpeed, command.maxSpeed, command.value);
+            if (this->jogging) {  // Same speed, new limits
+                this->resumeRamp();
+                this->runAt(this->jog_speed);
+            }
+            break;
+        case SET_JERK:
+            this->jerkTime = command.value;
+            if (this->smoothActivated) {
+                this->scurve.configure(this->vmin, this->vmax, this->acc,
+                                       this->jerkTime > 0 ? this->acc / this->jerkTime : 0);  // step/ms³
+            }
+            break;
+        case RUN_SPEED:
+            this->runAt(command.minSpeed);
+            break;
+        case TRACK_POSITION:
+            this->track(command.value, command.date, command.minSpeed);
+            break;
+        case PLAY_TRAJECTORY:
+            if (this->direction == 0 && this->step_to_be == this->current_step) {
+                this->startTrajectory(command.trajectory);
+            } else {  // Compiled from standstill, planned as usual
+                this->step_to_be += command.trajectory->steps;
+                command.trajectory->users--;
+            }
+            break;
+    }
+}
+
+/*
+ * Play a cached move from standstill: the first step is now.
+ */
+void SmoothStepper::startTrajectory(SmoothTrajectory *trajectory) {
+    int direction = trajectory->direction;
+    unsigned long interval = 0;
+    this->trajectory = trajectory;
+    this->trajectory_position = 0;
+    this->trajectory_repeat = 0;
+    if (!trajectory->next(&this->trajectory_position, &this->trajectory_repeat, &interval, &direction)) {
+        this->endTrajectory();  // No step
+        return;
+    }
+    this->step_to_be += trajectory->steps;
+    this->direction = direction;
+    this->step_interval = interval;
+}
+
+/*
+ * Take the interval and the direction of the next step from the table,
+ * after a step.
+ */
+void SmoothStepper::trajectoryStep() {
+    int direction = this->direction;
+    unsigned long interval = this->step_interval;
+    if (this->trajectory->next(&this->trajectory_position, &this->trajectory_repeat, &interval, &direction)) {
+        this->direction = direction;
+        this->step_interval = interval;
+        return;
+    }
+
+    // Arrived at vmin, like the ramp
+    this->endTrajectory();
+    this->direction = 0;
+    this->newSpeed = this->vmin;
+    this->current_speed = this->vmin;
+    this->ramp.reset();
+}
+
+/*
+ * A command during a cached move: the ramp goes on from the current speed.
+ */
+void SmoothStepper::leaveTrajectory() {
+    this->resumeRamp();
+    this->endTrajectory();
+}
+
+/*
+ * Give the table back to the cache.
+ */
+void SmoothStepper::endTrajectory() {
+    this->trajectory->users--;
+    this->trajectory = nullptr;
+}
+
+/*
+ * Set the ramps to the speed of the last step interval, so that they go
+ * on from there.
+ */
+void SmoothStepper::resumeRamp() {
+    float speed = 1000.0f / this->step_interval;  // step/ms
+    if (speed < this->vmin) speed = this->vmin;
+    if (this->smoothActivated && speed > this->vmax) speed = this->vmax;
+    this->newSpeed = speed;
+    this->previousSpeed = speed;
+    this->current_speed = speed;
+    this->stopping = false;
+    this->ramp.setSpeed(speed);
+}
+
+/*
+ * The speed of the target is its move since the previous update, dated
+ * here because the STEP/DIR engine applies the commands ahead of time.
+ */
+bool SmoothStepper::trackPosition(int number_of_steps) {
+    StepperClock *clock = this->pulses != nullptr ? stepperDefaultClock() : this->clock;
+    unsigned long now = clock->micros();
+    unsigned long elapsed = now - this->track_sent_time;
+    float speed = 0;  // step/ms
+    if (elapsed > 0 && elapsed < SMOOTHSTEPPER_TRACK_TIMEOUT) {
+        speed = (number_of_steps - this->track_sent) * 1000.0f / elapsed;
+    }
+
+    Command command = {TRACK_POSITION, number_of_steps, speed, 0};
+    command.date = now;
+    if (!this->sendCommand(command)) {
+        return false;
+    }
+    this->track_sent = number_of_steps;
+    this->track_sent_time = now;
+    return true;
+}
+
+/*
+ * New position, at date (us), and speed (step/ms) of the tracked target,
+ * from the step loop. The first update of a tracking has no speed.
+ */
+void SmoothStepper::track(long position, unsigned long date, float speed) {
+    if (this->tracking && this->smoothActivated) {
+        if (speed > this->vmax) speed = this->vmax;
+        if (speed < -this->vmax) speed = -this->vmax;
+        this->track_speed = speed;
+    } else {
+        this->track_speed = 0;
+    }
+    this->tracking = true;
+    this->track_date = date;
+    this->step_to_be = position;
+}
+
+bool SmoothStepper::runSpeed(float speed) {
+    Command command = {RUN_SPEED, 0, speed, 0};
+    return this->sendCommand(command);
+}
+
+/*
+ * Aim at a speed (rev/min) from the step loop, computed once here so that
+ * a step of the jog only walks the integer ramp.
+ */
+void SmoothStepper::runAt(float speed) {
+    if (!this->jogging) {  // From standstill or from the planner
+        if (this->direction != 0) this->resumeRamp();
+        this->jogging = true;
+        this->stopping = false;
+        this->step_to_be = this->current_step;
+    }
+    this->jog_speed = speed;
+    this->jog_direction = speed > 0 ? 1 : (speed < 0 ? -1 : 0);
+
+    float v = fabs(speed) * this->number_of_steps / 60 / 1000;  // step/ms
+    if (v < this->vmin) v = this->vmin;
+    if (this->smoothActivated && v > this->vmax) v = this->vmax;
+    this->jog_interval = 1000 / v;
+
+    uint32_t interval = this->ramp.intervalMicros();
+    this->jog_ramp = interval > this->jog_interval ? 1 : (interval < this->jog_interval ? -1 : 0);
+}
+
+/*
+ * Jog from standstill: start in the asked direction at minSpeed, or end
+ * the jog when asked to stop.
+ */
+void SmoothStepper::startJog() {
+    if (this->jog_direction == 0) {
+        this->jogging = false;
+        return;
+    }
+    this->direction = this->jog_direction;
+    this->ramp.reset();
+    this->jog_ramp = 1;
+    this->step_interval = this->smoothActivated ? this->ramp.intervalMicros() : this->jog_interval;
+}
+
+/*
+ * Next step interval of the jog, after a step: ramp toward the asked speed,
+ * through minSpeed to stop or turn back. Constant cost, no target.
+ */
+void SmoothStepper::jogStep() {
+    this->step_to_be = this->current_step;
+
+    if (this->jog_direction != this->direction) {  // Stop first
+        if (!this->smoothActivated || this->ramp.atVmin()) {
+            this->direction = 0;
+            this->jogging = this->jog_direction != 0;
+            this->newSpeed = this->vmin;
+            return;
+        }
+        this->ramp.deccelerate();
+        this->step_interval = this->ramp.intervalMicros();
+        return;
+    }
+    if (!this->smoothActivated) {
+        this->step_interval = this->jog_interval;
+        return;
+    }
+
+    if (this->jog_ramp > 0) {
+        this->ramp.accelerate();
+        if (this->ramp.intervalMicros() <= this->jog_interval || this->ramp.atVmax()) this->jog_ramp = 0;
+    } else if (this->jog_ramp < 0) {
+        this->ramp.deccelerate();
+        if (this->ramp.intervalMicros() >= this->jog_interval || this->ramp.atVmin()) this->jog_ramp = 0;
+    }
+    this->step_interval = this->jog_ramp != 0 ? this->ramp.intervalMicros() : this->jog_interval;
 }
 
 /*
@@ -76,9 +76,81 @@
 #ifndef SmoothStepper_h
 #define SmoothStepper_h
 
+#include <atomic>
+
+#include "SmoothRamp.h"
+#include "SmoothSCurve.h"
+#include "SmoothStepperHal.h"
+#include "SmoothStepperQueue.h"
+#include "SmoothStepperSequence.h"
+#include "SmoothStepperTiming.h"
+#include "SmoothStepperTrace.h"
+
+#ifndef SMOOTHSTEPPER_COMMAND_QUEUE_SIZE
+#define SMOOTHSTEPPER_COMMAND_QUEUE_SIZE 16  // Commands waiting for the step loop, power of 2
+#endif
+
+#ifndef SMOOTHSTEPPER_MOTION_QUEUE_SIZE
+#define SMOOTHSTEPPER_MOTION_QUEUE_SIZE 8  // Queued moves the planner can look at, power of 2
+#endif
+
+#ifndef SMOOTHSTEPPER_TRACK_TIMEOUT
+#define SMOOTHSTEPPER_TRACK_TIMEOUT 100000  // us, a tracked target updated less often is at rest
+#endif
+
+class SmoothStepperGroup;
+struct SmoothTrajectory;
+
+/*
+ * Clock of the STEP/DIR planner: the date of the step being planned, ahead
+ * of the board clock by the chunks waiting in the pulse generator.
+ */
+class StepperPlanningClock : public StepperClock {
+   public:
+    unsigned long micros() { return this->now; }
+
+    unsigned long now = 0;
+};
+
 // library interface description
 class SmoothStepper {
    public:
+    // How the speed ramp is computed
+    enum RampBackend : uint8_t {
+        RAMP_FLOAT,  // speed = f(time) in float, default
+        RAMP_FIXED,  // integer only step interval recurrence (SmoothRamp.h)
+        RAMP_EXACT   // speed = f(position) in float, ends on the target
+    };
+
+    // Speed settings given by the application
+    struct Profile {
+        float minSpeed;  // rev/min
+        float maxSpeed;  // rev/min, 0 without acceleration
+        long rampTime;   // ms, 0 without acceleration
+        long jerkTime;   // ms, 0 for linear ramps
+    };
+
+    // What the step loop is doing
+    enum Planner {
+        PLANNER_IDLE,      // Arrived
+        PLANNER_MOVING,    // Accelerating or at speed toward the target
+        PLANNER_STOPPING,  // Deccelerating
+        PLANNER_JOGGING,   // runSpeed()
+        PLANNER_PLAYING    // Cached move (SmoothTrajectoryCache.h)
+    };
+
+    // State of the motor at a step, returned by snapshot()
+    struct State {
+        long position;            // Current step
+        long target;              // Step to be
+        float speed;              // rev/min, negative backward, 0 at standstill
+        int8_t direction;         // 1, -1 or 0 at standstill
+        uint8_t phase;            // In the phase sequence
+        Planner planner;
+        bool arrived;             // Like isArrived() == 0
+        unsigned long last_step;  // Date (us) of the last step
+    };
+
     // constructors:
     SmoothStepper(int number_of_steps, int motor_pin_1, int motor_pin_2);
     SmoothStepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
@@ -86,13 +158,49 @@ class SmoothStepper {
     SmoothStepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
                   int motor_pin_3, int motor_pin_4, int motor_pin_5);
 
+    /**
+     * Custom phase table, like FourWireHalfSequence (SmoothStepperSequence.h):
+     * - phases: pin levels of each step, pins[0] is the leftmost of pin_count bits
+     * - microsteps: steps of the table per full step, the motor makes
+     *   number_of_steps * microsteps steps per revolution
+     * The tables are copied. A table that doesn't fit (pin_count 1 to 8,
+     * phase_count 1 to 255, pins 0 to 63, microsteps from 1) is rejected:
+     * the motor drives no pin, see hasPins().
+     * */
+    SmoothStepper(int number_of_steps, const int *pins, int pin_count,
+                  const uint8_t *phases, int phase_count, int microsteps = 1);
+    ~SmoothStepper();
+
+    /**
+     * Motor of a STEP/DIR driver (A4988, TMC...), without coil pins:
+     * started with begin(StepperPulseGenerator *).
+     * */
+    explicit SmoothStepper(int number_of_steps);
+
     /**
      * To call after
      * accelerationEnable()
      * or
      * accelerationDisable()
+     * The config sets the core, priority and stack of the task, and its
+     * memory when it must not come from the heap (StepperTaskMemory).
+     * */
+    void begin(const StepperTaskConfig &config = StepperTaskConfig());
+
+    /**
+     * Timer driven alternative to begin():
+     * each step is done from the timer callback, no task is busy waiting.
+     * The timer must outlive the motor.
+     * */
+    void begin(StepperTimer *timer);
+
+    /**
+     * STEP/DIR alternative to begin(): the task plans the steps ahead in
+     * chunks of pulse intervals, played by the generator on its own.
+     * The position is the one planned, up to two chunks ahead of the shaft.
+     * The generator must outlive the motor.
      * */
-    void begin();
+    void begin(StepperPulseGenerator *pulses, const StepperTaskConfig &config = StepperTaskConfig());
 
     /**
      * To Enable acceleration
@@ -106,87 +214,365 @@ class SmoothStepper {
      * To Disable acceleration
      * - speed (rev/min)
      * */
-    void accelerationDisable(float speed);
+    bool accelerationDisable(float speed);
+
+    /**
+     * Select how the speed ramp is computed, to call before begin().
+     * RAMP_FIXED keeps float and double away from the step path.
+     * RAMP_EXACT solves the trapezoid (or triangle) of each move in steps,
+     * its decceleration ends at vmin exactly on the target.
+     * */
+    void setRampBackend(RampBackend backend);
+
+    /**
+     * Jerk limited (S-curve) ramps instead of linear ones, with RAMP_FLOAT.
+     * - jerkTime (ms): time for the acceleration to go from 0 to its
+     *   maximum, 0 for linear ramps
+     * */
+    bool setJerk(long jerkTime);
+
+    /**
+     * The commands below are queued for the step loop and never block.
+     * They return false when the queue is full (the command is ignored).
+     * */
 
     /**
      * Add or substrace steps to move
      * */
-    void step(int number_of_steps);
+    bool step(int number_of_steps);
 
     /**
      * Absolute step to be
      * */
-    void absolutePosition(int number_of_steps);
+    bool absolutePosition(int number_of_steps);
+
+    /**
+     * Run at a speed until another move (jog):
+     * - speed (rev/min), negative backward, 0 to stop
+     * Ramps from the current speed with the acceleration of
+     * accelerationEnable(), within its minSpeed and maxSpeed, turning back
+     * through minSpeed. Call it again at any time to change the speed.
+     * */
+    bool runSpeed(float speed);
+
+    /**
+     * Absolute step to be of a moving target, sent periodically (tracking).
+     * The speed of the target is estimated from the updates and, with
+     * RAMP_EXACT, the motor is planned to reach it at that speed instead of
+     * stopping on each update. Keep sending it while tracking, even when it
+     * doesn't move. Like absolutePosition() with the other ramp backends.
+     * */
+    bool trackPosition(int number_of_steps);
 
     int version(void);
 
     // Return true when arrived
     int isArrived();
 
-    // Wait until motor is arrived
-    void waitUntilArrived();
+    /**
+     * Position, target, speed, direction, phase and planner state at once,
+     * as the step loop left them after its last step or command: never a
+     * mix of two steps, from any task or core. Costs a copy, the step loop
+     * is never held (seqlock), so it can be polled at kHz rates.
+     * */
+    State snapshot();
+
+    /**
+     * Record the steps, direction changes and planner state changes in
+     * trace (SmoothStepperTrace.h), nullptr to stop. To call at standstill.
+     * */
+    void setTrace(StepTraceLog *trace) { this->trace = trace; }
+
+    /**
+     * Wait until motor is arrived, blocked (no CPU used) until the step
+     * loop signals the arrival.
+     * Return false when still not arrived after timeout (ms).
+     * */
+    bool waitUntilArrived(unsigned long timeout = STEPPER_WAIT_FOREVER);
+
+    typedef void (*ArrivalCallback)(SmoothStepper *stepper, void *arg);
 
-    // Return absolute step number
+    /**
+     * Function called by the step loop each time the motor arrives, to call
+     * before begin(). It runs in the step loop: keep it short.
+     * */
+    void onArrival(ArrivalCallback callback, void *arg);
+
+    // Return the step number within the rotation (steps of the sequence)
     int whatStepNumber();
 
+    // Return false for a STEP/DIR motor, or when its pins or phase table were rejected
+    bool hasPins();
+
     // Return abosulte rotation number
     int whatRotationNumber();
 
+    /**
+     * Queue a relative move after the current target and the moves already
+     * queued. The speed is carried from one move to the next in the same
+     * direction, the motor only deccelerates when the queued distance left
+     * requires it.
+     * */
+    bool queueMove(int number_of_steps);
+
+    /**
+     * Number of queued moves the planner looks at
+     * (1 to SMOOTHSTEPPER_MOTION_QUEUE_SIZE, default all).
+     * 1 stops at the end of each move.
+     * */
+    void setLookAhead(int moves);
+
     // Go to Origin
-    void goToOrigin(bool rotation_included);
+    bool goToOrigin(bool rotation_included);
 
     // Wait untile arrived and set origin to current position
     void setOrigin();
 
     // Stop to move
-    void stopMove();
+    bool stopMove();
+
+#if SMOOTHSTEPPER_TIMING
+    // Timing of the last steps and counters, see SmoothStepperTiming.h
+    StepTimingLog *timingLog();
+#endif
+
+   protected:
+    // For SmoothStepperMotor, output is set before setPins()
+    StepperOutput *output = nullptr;  // Outputs of the pins, the GPIO when nullptr
+    void setPins(const int *pins, int pin_count, const uint8_t *phases,
+                 int phase_count, int microsteps, StepperPinMask *masks);
 
    private:
+    friend class SmoothStepperGroup;
+    friend class SmoothStepperCoordinator;
+    friend class SmoothStepperBenchmark;
+    friend class SmoothStepperGcode;
+    friend class SmoothTrajectoryCache;
+
+    // Commands given to the step loop
+    enum CommandType {
+        MOVE_RELATIVE,  // value: steps
+        MOVE_ABSOLUTE,  // value: step to be
+        MOVE_QUEUED,    // value: steps
+        STOP,
+        GO_TO_ORIGIN,   // value: rotation included
+        SET_ORIGIN,
+        SET_SPEED,      // value: ramp time (ms), 0 for no acceleration
+        SET_JERK,       // value: jerk time (ms), 0 for linear ramps
+        PLAY_TRAJECTORY,  // trajectory: cached move
+        RUN_SPEED,        // minSpeed: speed (rev/min)
+        TRACK_POSITION    // value: moving target, minSpeed: its speed (step/ms), date
+    };
+
+    struct Command {
+        uint8_t type;
+        union {
+            long value;
+            SmoothTrajectory *trajectory;
+        };
+        float minSpeed;  // SET_SPEED (rev/min)
+        union {
+            float maxSpeed;      // SET_SPEED (rev/min)
+            unsigned long date;  // TRACK_POSITION: us, when the target was at value
+        };
+    };
+
     // Private Methods
     void stepMotor(int this_step);
+    void writePins(StepperPinMask set, StepperPinMask clear);
+    void hold(bool holding);
     void calculStrategy();
     float calculateDelay();
+    void updateDelay();
+    void restartDelay();
+    float exactSpeed(long position);
+    float exactLeft(long position);
+    void publish();
+    float trackDrift();
+    bool isAtVmin();
+    bool isSCurve();
     double calculateStartTime();
     void doStep();
+    bool poll(unsigned long now);
+    bool isMoving();
+    unsigned long nextStepTime();
+    void wakeTimer();
+    bool sendCommand(const Command &command);
+    void applyCommand(const Command &command);
+    void setSpeed(float minSpeed, float maxSpeed, long rampTime);
+    void notifyArrival();
+    bool planSegments();
+    void startTrajectory(SmoothTrajectory *trajectory);
+    void trajectoryStep();
+    void leaveTrajectory();
+    void endTrajectory();
+    void resumeRamp();
+    void runAt(float speed);
+    void startJog();
+    void jogStep();
+    void track(long position, unsigned long date, float speed);
+    int planChunk(uint32_t *intervals, int *direction);
+#if SMOOTHSTEPPER_TIMING
+    void recordTiming(bool starting);
+#endif
 
     //volatile variriables
-    volatile int direction = 0;             // Direction of rotation
+    volatile int8_t direction = 0;          // Direction of rotation
+    volatile bool smoothActivated = false;  // Smooth activated
     volatile long step_to_be = 0;           // Global step to be
     volatile long current_step = 0;         // Current step
-    volatile int steps_to_move = 0;         // Step to add/substract to step_to_be
-    volatile int number_of_steps;           // Total number of steps this motor can take
-    volatile bool smoothActivated = false;  // Smooth activated
+    volatile int number_of_steps;           // Steps of the sequence per revolution
     volatile float vmin;                    // Minimum speed (step/ms)
     volatile float current_speed = 0;       // Current speed (step/ms)
     volatile float vmax;                    // Maximum speed (step/ms)
-    volatile double previousSpeed = 0;      // Previous calculated speed
+    volatile float previousSpeed = 0;       // Previous calculated speed
     volatile float acc;                     // Acceleration (step/ms²)
     volatile int stepVmaxToVmin;            // Number of steps to reach vmax from vmin
 
-    //static variables
-    static int numberOfTasks;
-
     //non static and non volatile variables
-    int pin_count;               // How many pins are in use
-    int step_number = 0;         // Which step the motor is on
     int deccelerationAtStep;     // At which step do we start to stop
     long start_time;             // Start time to calculate acceleration (ms)
     bool stopping = false;       // Are we stopping
+    RampBackend rampBackend = RAMP_FLOAT;
     float newDelay = 9.77;       // Delay to wait before next step
     float newSpeed = 0;          // Speed calculated
-    float newDelay_last = 9.77;  // Last delay calculated
-    char task_name[20];
+    unsigned long last_step_time = 0;  // Time stamp (us) of the last step
+    unsigned long step_interval = 9770;  // Delay to wait before next step (us)
+    SmoothRamp ramp;                     // Integer ramp (RAMP_FIXED)
+    long exact_origin = 0;               // Position of exact_speed2 (RAMP_EXACT)
+    long exact_end = 0;                  // Position where the speed is back to vmin (RAMP_EXACT)
+    float exact_speed2 = 0;              // Speed² at exact_origin (step²/ms², RAMP_EXACT)
+    float exact_end_speed2 = 0;          // Speed² at exact_end (step²/ms², RAMP_EXACT)
+    float exact_drift = 0;               // Speed of exact_end away from the motor (step/ms, RAMP_EXACT)
+    long jerkTime = 0;                   // S-curve when > 0 (ms)
+    SmoothSCurve scurve;                 // S-curve ramp (RAMP_FLOAT)
+    Profile profile = {0, 0, 0, 0};      // Last speed settings sent (application side)
+
+    // cached move played instead of the ramp (step loop only)
+    SmoothTrajectory *trajectory = nullptr;
+    uint32_t trajectory_position = 0;  // Next word of the table
+    uint16_t trajectory_repeat = 0;    // Steps left with the same interval
+
+    // jog (step loop only)
+    bool jogging = false;
+    int8_t jog_direction = 0;    // Asked direction, 0 to stop
+    int8_t jog_ramp = 0;         // Accelerating (1), deccelerating (-1) or at speed (0)
+    float jog_speed = 0;         // Asked speed (rev/min)
+    uint32_t jog_interval = 0;   // Step interval at the asked speed (us)
+
+    // tracked target
+    long track_sent = 0;                // Last position sent (application side)
+    unsigned long track_sent_time = 0;  // Date (us) it was sent (application side)
+    bool tracking = false;              // Step loop only
+    float track_speed = 0;              // Speed of the target (step/ms), negative backward (step loop only)
+    unsigned long track_date = 0;       // Date (us) of step_to_be on the target (step loop only)
+
+    // state for snapshot(), written by the step loop only
+    struct Published {
+        long position;
+        long target;
+        uint32_t interval;  // us
+        int8_t direction;
+        uint8_t phase;
+        uint8_t planner;
+        bool arrived;
+        unsigned long last_step;
+    };
+    volatile Published published = {0, 0, 0, 0, 0, PLANNER_IDLE, true, 0};
+    std::atomic<uint32_t> published_sequence{0};  // Odd while published is written
+
+    // pins written at each step
+    StepperPinMask pins_mask = 0;                 // All the motor pins
+    const StepperPinMask *phase_masks = nullptr;  // Motor pins high at each phase
+    StepperPinMask *owned_masks = nullptr;        // phase_masks allocated by the constructor
+    uint8_t phase_count = 0;                      // Length of the phase sequence
+    uint8_t phase = 0;                            // Which phase the motor is on
+    StepperPortBatch *batch = nullptr;            // Pins written later by the group
+
+    // STEP/DIR output
+    StepperPulseGenerator *pulses = nullptr;  // Plays the planned steps
+    StepperPlanningClock planning;            // Date of the planned step
+    uint32_t carry_interval = 0;              // Planned step left for the next chunk...
+    int8_t carry_direction = 0;               // ...in this direction, 0 for none
+    bool pulse_arrived = true;                // Arrived at the last task turn
+
+    // clock and timer
+    StepperClock *clock = stepperDefaultClock();
+    StepperTimer *timer = nullptr;          // Timer of the timer driven engine
+    SmoothStepperGroup *group = nullptr;    // Group servicing this motor
+    volatile bool timer_running = false;    // Timer armed or callback running
+    bool started = false;                   // Step loop running
+
+    // commands from the application to the step loop
+    StepperQueue<Command, SMOOTHSTEPPER_COMMAND_QUEUE_SIZE> commands;
+
+    // arrival
+    StepperSignal arrival;
+    ArrivalCallback arrivalCallback = nullptr;
+    void *arrivalArg = nullptr;
+
+    // queued moves (step loop only)
+    StepperQueue<long, SMOOTHSTEPPER_MOTION_QUEUE_SIZE> segments;
+    long segment_start = 0;  // Step where the first queued move starts
+    long segment_end = 0;    // Step where the first queued move ends
+    int lookAhead = SMOOTHSTEPPER_MOTION_QUEUE_SIZE;
+
+    StepTraceLog *trace = nullptr;
 
-    // motor pin numbers:
-    int motor_pin_1;
-    int motor_pin_2;
-    int motor_pin_3;
-    int motor_pin_4;
-    int motor_pin_5;  // Only 5 phase motor
+#if SMOOTHSTEPPER_TIMING
+    StepTimingLog timing;
+    unsigned long timing_last_step = 0;  // Actual time stamp (us) of the last step
+#endif
 
     // task
-    static void staticSmoothStepperTask(void *pvParameters);
-    void smoothStepperTask();
+    StepperTask task;
+    static unsigned long staticSmoothStepperTask(void *pvParameters, unsigned long now);
+    unsigned long smoothStepperTask(unsigned long now);
+    static void staticTimerCallback(void *arg);
+    void timerCallback();
+    static unsigned long staticPulseTask(void *pvParameters, unsigned long now);
+    unsigned long pulseTask(unsigned long now);
+};
+
+/*
+ * Motor with the number of wires and the phase sequence fixed at compile
+ * time, from the constexpr tables of SmoothStepperSequence.h: an instance
+ * only stores the masks of its own sequence.
+ *
+ *   SmoothStepperMotor<4> motor(2048, 23, 22, 21, 19);
+ *   SmoothStepperMotor<2, TwoWireSequence> motor2(2048, 18, 5);
+ *   SmoothStepperMotor<4, FourWireHalfSequence> motor3(2048, 17, 16, 4, 0);
+ *
+ * Given a StepperOutput first, the pins are outputs of it, like the Q
+ * outputs of a shift register chain, and no GPIO is set up:
+ *   BoardShiftRegister chain(2, 23, 18, 5);
+ *   SmoothStepperMotor<4> motor4(&chain, 2048, 0, 1, 2, 3);
+ */
+template <int PinCount, class Sequence = typename StepperSequenceFor<PinCount>::type>
+class SmoothStepperMotor : public SmoothStepper {
+    static_assert(Sequence::pins == PinCount, "The sequence is for another number of wires");
+
+   public:
+    template <typename... Pins>
+    SmoothStepperMotor(int number_of_steps, Pins... motor_pins) : SmoothStepper(number_of_steps) {
+        static_assert(sizeof...(Pins) == PinCount, "One pin per wire");
+        const int pins[PinCount] = {motor_pins...};
+        this->setPins(pins, PinCount, Sequence::phases, Sequence::length, Sequence::microsteps,
+                      this->masks);
+    }
+
+    template <typename... Pins>
+    SmoothStepperMotor(StepperOutput *output, int number_of_steps, Pins... motor_pins)
+        : SmoothStepper(number_of_steps) {
+        static_assert(sizeof...(Pins) == PinCount, "One pin per wire");
+        const int pins[PinCount] = {motor_pins...};
+        this->output = output;
+        this->setPins(pins, PinCount, Sequence::phases, Sequence::length, Sequence::microsteps,
+                      this->masks);
+    }
+
+   private:
+    StepperPinMask masks[Sequence::length];
 };
 
 #endif
\ No newline at end of file
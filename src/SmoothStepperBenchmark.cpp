@@ -0,0 +1,414 @@
+/*
+ * SmoothStepperBenchmark.cpp - Step timing benchmarks of the SmoothStepper library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothStepperBenchmark.h"
+
+#include <stdio.h>
+
+#include "SmoothStepper.h"
+#include "SmoothStepperCoordinator.h"
+#include "SmoothStepperGroup.h"
+#include "SmoothTrajectoryCache.h"
+
+const int stepsPerRevolution = 2048;
+const long iterations = 20000;
+
+SmoothStepperBenchmark::SmoothStepperBenchmark(StepperClock *clock, Output output) {
+    this->clock = clock;
+    this->output = output;
+}
+
+void SmoothStepperBenchmark::runAll(int maxMotors) {
+    this->output("benchmark,parameter,value,unit");
+    this->benchMemory();
+    this->benchCalculStrategy();
+    this->benchCalculateDelay();
+    this->benchStepMotor();
+    this->benchSnapshot();
+    this->benchTrace();
+    this->benchThroughput(maxMotors);
+    this->benchCoordinator();
+    this->benchJitter(5000);
+    this->benchTimerJitter(5000);
+}
+
+void SmoothStepperBenchmark::print(const char *benchmark, const char *parameter,
+                                   double value, const char *unit) {
+    char line[80];
+    snprintf(line, sizeof(line), "%s,%s,%.1f,%s", benchmark, parameter, value, unit);
+    this->output(line);
+}
+
+void SmoothStepperBenchmark::benchMemory() {
+    this->print("memory", "SmoothStepper", sizeof(SmoothStepper), "bytes");
+    this->print("memory", "SmoothStepperMotor<4>", sizeof(SmoothStepperMotor<4>), "bytes");
+    this->print("memory", "task", STEPPER_TASK_STACK + STEPPER_TASK_CONTROL_SIZE, "bytes");
+    this->print("memory", "perMotorTask", sizeof(SmoothStepperMotor<4>) + STEPPER_TASK_STACK + STEPPER_TASK_CONTROL_SIZE, "bytes");
+}
+
+void SmoothStepperBenchmark::benchCalculStrategy() {
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(3, 15, 500);
+
+    unsigned long start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        stepper.direction = 0;
+        stepper.step_to_be = i % 2000 + 1;
+        stepper.calculStrategy();
+    }
+    unsigned long duration = this->clock->micros() - start;
+
+    this->print("calculStrategy", "float", duration * 1000.0 / iterations, "ns");
+}
+
+void SmoothStepperBenchmark::benchCalculateDelay() {
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(3, 15, 500);
+    stepper.clock = this->clock;
+
+    unsigned long start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        stepper.newDelay = stepper.calculateDelay();
+    }
+    unsigned long duration = this->clock->micros() - start;
+    this->print("calculateDelay", "float", duration * 1000.0 / iterations, "ns");
+
+    // Whole delay update done after a step, with each backend and the S-curve
+    const SmoothStepper::RampBackend backends[] = {SmoothStepper::RAMP_FLOAT, SmoothStepper::RAMP_FIXED,
+                                                   SmoothStepper::RAMP_FLOAT, SmoothStepper::RAMP_EXACT};
+    const long jerkTimes[] = {0, 0, 100, 0};
+    const char *names[] = {"float", "fixed", "scurve", "exact"};
+    for (int backend = 0; backend < 4; backend++) {
+        this->print("updateDelay", names[backend], this->updateDelayCost(backends[backend], jerkTimes[backend], iterations), "ns");
+    }
+
+    // Table walk of a cached move instead
+    SmoothStepper cached(stepsPerRevolution);
+    cached.accelerationEnable(3, 15, 500);
+    SmoothTrajectoryCache cache(16384);
+    SmoothTrajectory *trajectory = cache.find(&cached, 2000);
+    uint32_t position = 0;
+    uint16_t repeat = 0;
+    unsigned long interval = 0;
+    int direction = 1;
+    volatile unsigned long used;  // Keeps the walk
+    start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        if (!trajectory->next(&position, &repeat, &interval, &direction)) {
+            position = 0;
+            repeat = 0;
+        }
+        used = interval;
+    }
+    (void)used;
+    duration = this->clock->micros() - start;
+    this->print("updateDelay", "table", duration * 1000.0 / iterations, "ns");
+}
+
+/*
+ * The ramp speeds up for 100 steps then slows down for 100 steps, in turn.
+ */
+double SmoothStepperBenchmark::updateDelayCost(SmoothStepper::RampBackend backend, long jerkTime, long iterations) {
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(3, 15, 500);
+    stepper.clock = this->clock;
+    stepper.setRampBackend(backend);
+    stepper.setJerk(jerkTime);
+    stepper.direction = 1;  // Half way of a move, for the exact ramp
+    stepper.current_step = 500;
+    stepper.exact_end = 1000;
+
+    unsigned long start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        stepper.stopping = (i / 100) % 2;
+        stepper.updateDelay();
+    }
+    unsigned long duration = this->clock->micros() - start;
+    return duration * 1000.0 / iterations;
+}
+
+void SmoothStepperBenchmark::benchStepMotor() {
+    SmoothStepper stepper2(stepsPerRevolution, 23, 22);
+    SmoothStepper stepper4(stepsPerRevolution, 23, 22, 21, 19);
+    SmoothStepper stepper5(stepsPerRevolution, 23, 22, 21, 19, 18);
+    SmoothStepperMotor<4> stepperT(stepsPerRevolution, 23, 22, 21, 19);
+    SmoothStepper *steppers[] = {&stepper2, &stepper4, &stepper5, &stepperT};
+    const char *names[] = {"2 pins", "4 pins", "5 pins", "4 pins template"};
+
+    for (int s = 0; s < 4; s++) {
+        SmoothStepper *stepper = steppers[s];
+        unsigned long start = this->clock->micros();
+        for (long i = 0; i < iterations; i++) {
+            stepper->stepMotor(i % stepper->phase_count);
+        }
+        unsigned long duration = this->clock->micros() - start;
+        this->print("stepMotor", names[s], duration * 1000.0 / iterations, "ns");
+    }
+}
+
+void SmoothStepperBenchmark::benchSnapshot() {
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(3, 15, 500);
+
+    unsigned long start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        stepper.current_step = i;
+        stepper.publish();
+    }
+    unsigned long duration = this->clock->micros() - start;
+    this->print("snapshot", "publish", duration * 1000.0 / iterations, "ns");
+
+    volatile long used = 0;
+    start = this->clock->micros();
+    for (long i = 0; i < iterations; i++) {
+        used = stepper.snapshot().position;
+    }
+    (void)used;
+    duration = this->clock->micros() - start;
+    this->print("snapshot", "read", duration * 1000.0 / iterations, "ns");
+}
+
+/*
+ * The steps of a move planned offline, recorded in a trace drained when
+ * it is full.
+ */
+void SmoothStepperBenchmark::benchTrace() {
+    SmoothStepper stepper(stepsPerRevolution);
+    stepper.clock = &stepper.planning;
+    stepper.accelerationEnable(3, 15, 500);
+    stepper.step(2000);
+    stepper.calculStrategy();
+
+    const int steps = 2000;
+    static unsigned long dates[steps];  // 8 KB, not on the stack of the task
+    for (int i = 0; i < steps && stepper.isMoving(); i++) {
+        dates[i] = stepper.nextStepTime();
+        stepper.planning.now = dates[i];
+        stepper.poll(dates[i]);
+    }
+
+    static uint8_t buffer[4096];  // More than a move
+    uint8_t drained[256];
+    StepTraceLog trace(buffer, sizeof(buffer));
+    unsigned long bytes = 0;
+    unsigned long duration = 0;
+    for (long move = 0; move < iterations / steps; move++) {
+        unsigned long start = this->clock->micros();
+        for (int i = 0; i < steps; i++) {
+            trace.step(dates[i] + move * dates[steps - 1], 1, i);
+        }
+        duration += this->clock->micros() - start;
+
+        size_t count;
+        while ((count = trace.read(drained, sizeof(drained))) > 0) bytes += count;
+    }
+    long recorded = iterations / steps * steps;
+    this->print("trace", "record", duration * 1000.0 / recorded, "ns");
+    this->print("trace", "bytes", (double)bytes / recorded, "per step");
+}
+
+/*
+ * The motors are given steps 1 us apart and the group is polled with a
+ * date always ahead of them, so it never waits: the measured rate is the
+ * CPU limit of the step path.
+ */
+void SmoothStepperBenchmark::benchThroughput(int maxMotors) {
+    if (maxMotors > SMOOTHSTEPPER_GROUP_SIZE) maxMotors = SMOOTHSTEPPER_GROUP_SIZE;
+
+    for (int motors = 1; motors <= maxMotors; motors++) {
+        SmoothStepper *steppers[SMOOTHSTEPPER_GROUP_SIZE];
+        SmoothStepperGroup group;
+        for (int motor = 0; motor < motors; motor++) {
+            steppers[motor] = new SmoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+            steppers[motor]->accelerationDisable(60000000.0 / stepsPerRevolution);  // 1 step/us
+            group.add(steppers[motor]);
+            steppers[motor]->calculStrategy();
+            steppers[motor]->step(1000000);
+        }
+
+        unsigned long date = 0;
+        unsigned long start = this->clock->micros();
+        for (long i = 0; i < iterations / motors; i++) {
+            date += 10;
+            group.poll(date);
+        }
+        unsigned long duration = this->clock->micros() - start;
+
+        long steps = 0;
+        for (int motor = 0; motor < motors; motor++) {
+            steps += steppers[motor]->current_step;
+            delete steppers[motor];
+        }
+
+        char parameter[16];
+        snprintf(parameter, sizeof(parameter), "%d motors", motors);
+        this->print("throughput", parameter, duration == 0 ? 0 : steps * 1000000.0 / duration, "steps/s");
+        this->print("stepCost", parameter, steps == 0 ? 0 : duration * 1000.0 / steps, "ns");
+    }
+}
+
+/*
+ * Same as benchThroughput(): the coordinator is polled with a date always
+ * ahead of its steps. Each tick steps the dominant axis and some of the others.
+ */
+void SmoothStepperBenchmark::benchCoordinator() {
+    for (int axes = 1; axes <= SMOOTHSTEPPER_MAX_AXES; axes++) {
+        SmoothStepper *steppers[SMOOTHSTEPPER_MAX_AXES];
+        long steps[SMOOTHSTEPPER_MAX_AXES];
+        SmoothStepperCoordinator coordinator;
+        coordinator.accelerationDisable(60000000.0 / stepsPerRevolution);  // 1 step/us
+        for (int axis = 0; axis < axes; axis++) {
+            steppers[axis] = new SmoothStepper(stepsPerRevolution, 23, 22, 21, 19);
+            coordinator.add(steppers[axis]);
+            steps[axis] = 1000000 / (axis + 1);
+        }
+        coordinator.move(steps);
+
+        unsigned long date = 0;
+        unsigned long start = this->clock->micros();
+        for (long i = 0; i < iterations; i++) {
+            date += 10;
+            coordinator.poll(date);
+        }
+        unsigned long duration = this->clock->micros() - start;
+
+        for (int axis = 0; axis < axes; axis++) {
+            delete steppers[axis];
+        }
+
+        char parameter[16];
+        snprintf(parameter, sizeof(parameter), "%d axes", axes);
+        this->print("coordinatedStep", parameter, duration * 1000.0 / iterations, "ns");
+    }
+
+    // Two queued moves at constant speed, stepped at the dates the loop asks
+    // for: the step interval across the junction must stay the steady one.
+    SmoothStepper axisX(stepsPerRevolution, 23, 22, 21, 19);
+    SmoothStepper axisY(stepsPerRevolution, 18, 5, 17, 16);
+    SmoothStepperCoordinator coordinator;
+    coordinator.add(&axisX);
+    coordinator.add(&axisY);
+    coordinator.accelerationDisable(15);
+    long move[] = {100, 50};
+    coordinator.move(move);
+    coordinator.move(move);
+
+    unsigned long date = 0;
+    unsigned long last = 0;
+    unsigned long shortest = (unsigned long)-1;
+    unsigned long junction = 0;
+    long position = axisX.current_step;
+    while (!coordinator.isArrived()) {
+        unsigned long now = date;
+        date = coordinator.coordinatorTask(now);
+        if (axisX.current_step == position) continue;
+        position = axisX.current_step;
+        if (position > 1 && now - last < shortest) shortest = now - last;
+        if (position == 101) junction = now - last;
+        last = now;
+    }
+    this->print("coordinatedJunction", "steady", 60000000.0 / 15 / stepsPerRevolution, "us");
+    this->print("coordinatedJunction", "junction", junction, "us");
+    this->print("coordinatedJunction", "shortest", shortest, "us");
+}
+
+/*
+ * The step loop runs here on the real clock, the error is how late each
+ * step is done compared to its planned interval.
+ */
+void SmoothStepperBenchmark::benchJitter(long steps) {
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(30, 300, 200);
+    stepper.clock = this->clock;
+    stepper.step(steps);
+    stepper.calculStrategy();
+
+    unsigned long histogram[BENCHMARK_HISTOGRAM_SIZE] = {0};
+    bool first = true;
+    while (stepper.isMoving()) {
+        unsigned long planned = stepper.step_interval;
+        unsigned long last_step_time = stepper.last_step_time;
+        unsigned long now = this->clock->micros();
+        if (!stepper.poll(now)) {
+            stepperYield();
+            continue;
+        }
+
+        if (first) {  // No previous step to compare with
+            first = false;
+            continue;
+        }
+        unsigned long error = (now - last_step_time) - planned;
+        if (error >= BENCHMARK_HISTOGRAM_SIZE) error = BENCHMARK_HISTOGRAM_SIZE - 1;
+        histogram[error]++;
+    }
+
+    this->printHistogram("jitter", histogram);
+}
+
+/*
+ * Timer of the board recording how late its callback runs after the
+ * armed date.
+ */
+class LatenessTimer : public StepperTimer {
+   public:
+    unsigned long histogram[BENCHMARK_HISTOGRAM_SIZE] = {0};
+
+    unsigned long micros() { return this->timer.micros(); }
+
+    void attach(Callback callback, void *arg) {
+        this->callback = callback;
+        this->arg = arg;
+        this->timer.attach(LatenessTimer::fire, this);
+    }
+
+    void armAt(unsigned long date) {
+        this->date = date;
+        this->timer.armAt(date);
+    }
+
+    void disarm() { this->timer.disarm(); }
+
+   private:
+    static void fire(void *arg) {
+        LatenessTimer *timer = reinterpret_cast<LatenessTimer *>(arg);
+        long late = (long)(timer->micros() - timer->date);
+        if (late < 0) late = 0;
+        if (late >= BENCHMARK_HISTOGRAM_SIZE) late = BENCHMARK_HISTOGRAM_SIZE - 1;
+        timer->histogram[late]++;
+        timer->callback(timer->arg);
+    }
+
+    BoardStepperTimer timer;
+    Callback callback = nullptr;
+    void *arg = nullptr;
+    volatile unsigned long date = 0;
+};
+
+/*
+ * A move of the timer engine on the timer of the board, the error is how
+ * late the callback doing each step runs.
+ */
+void SmoothStepperBenchmark::benchTimerJitter(long steps) {
+    LatenessTimer timer;
+    SmoothStepper stepper(stepsPerRevolution, 23, 22, 21, 19);
+    stepper.accelerationEnable(30, 300, 200);
+    stepper.begin(&timer);
+    stepper.step(steps);
+    stepper.waitUntilArrived();
+
+    this->printHistogram("timerJitter", timer.histogram);
+}
+
+void SmoothStepperBenchmark::printHistogram(const char *benchmark, const unsigned long *histogram) {
+    for (int error = 0; error < BENCHMARK_HISTOGRAM_SIZE; error++) {
+        char parameter[16];
+        snprintf(parameter, sizeof(parameter), "%s%d us", error == BENCHMARK_HISTOGRAM_SIZE - 1 ? ">=" : "", error);
+        this->print(benchmark, parameter, histogram[error], "steps");
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * SmoothStepperBenchmark.h - Step timing benchmarks of the SmoothStepper library.
+ *
+ * Measures the cost of the step path (calculStrategy(), calculateDelay(),
+ * stepMotor()), the maximum step rate of a group of 1..N motors, the cost
+ * of a coordinated step of 1..N axes, the error between the actual and
+ * the planned interval of the steps and how late the timer engine steps.
+ * Used by extras/bench/stepBenchmark.cpp on the host and by
+ * examples/benchmark.cpp on the board.
+ *
+ * Results are CSV lines: benchmark,parameter,value,unit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperBenchmark_h
+#define SmoothStepperBenchmark_h
+
+#include "SmoothStepper.h"
+#include "SmoothStepperHal.h"
+
+#define BENCHMARK_HISTOGRAM_SIZE 32  // Interval error buckets (us), the last one is "or more"
+
+class SmoothStepperBenchmark {
+   public:
+    typedef void (*Output)(const char *line);
+
+    /**
+     * - clock: real time clock used to measure
+     * - output: called with each CSV line
+     * */
+    SmoothStepperBenchmark(StepperClock *clock, Output output);
+
+    // Run every benchmark, the throughput one for 1 to maxMotors motors
+    void runAll(int maxMotors);
+
+    // Bytes of RAM per motor: the object and its task
+    void benchMemory();
+
+    // ns per calculStrategy()
+    void benchCalculStrategy();
+
+    // ns per calculateDelay() and per step of each ramp backend, the S-curve
+    // and a cached move
+    void benchCalculateDelay();
+
+    // ns per updateDelay() of a ramp backend (S-curve when jerkTime > 0),
+    // alone, over iterations
+    double updateDelayCost(SmoothStepper::RampBackend backend, long jerkTime, long iterations);
+
+    // ns per stepMotor() for 2, 4 and 5 pins and a SmoothStepperMotor<4>
+    void benchStepMotor();
+
+    // ns per publish() by the step loop and per snapshot() by a reader
+    void benchSnapshot();
+
+    // ns per step recorded in a trace and bytes per step of a move
+    void benchTrace();
+
+    // Maximum steps/s of a group of 1 to maxMotors motors
+    void benchThroughput(int maxMotors);
+
+    // ns per step of a coordinated move of 1 to SMOOTHSTEPPER_MAX_AXES axes, and
+    // step interval (us) across the junction of two queued moves
+    void benchCoordinator();
+
+    // Histogram of actual - planned step interval (us) over steps
+    void benchJitter(long steps);
+
+    // Histogram of the lateness (us) of the steps of the timer engine
+    // (begin(&timer)) on the timer of the board, over steps
+    void benchTimerJitter(long steps);
+
+   private:
+    void print(const char *benchmark, const char *parameter, double value, const char *unit);
+    void printHistogram(const char *benchmark, const unsigned long *histogram);
+
+    StepperClock *clock;
+    Output output;
+};
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * SmoothStepperCoordinator.cpp - Coordinated linear moves of several SmoothStepper motors.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothStepperCoordinator.h"
+
+int SmoothStepperCoordinator::add(SmoothStepper *stepper) {
+    if (this->count == SMOOTHSTEPPER_MAX_AXES) return -1;
+    for (int axis = 0; axis < this->count; axis++) {  // One output for all the axes
+        if (this->steppers[axis]->output != stepper->output) return -1;
+    }
+    this->batch.output = stepper->output;
+
+    int axis = this->count++;
+    this->steppers[axis] = stepper;
+    stepper->batch = &this->batch;
+    return axis;
+}
+
+void SmoothStepperCoordinator::begin(const StepperTaskConfig &config) {
+    this->task.service = SmoothStepperCoordinator::staticCoordinatorTask;
+    this->task.arg = this;
+    this->task.name = "stepperAxes";
+    stepperStartTask(&this->task, config);
+}
+
+void SmoothStepperCoordinator::begin(StepperTimer *timer) {
+    this->timer = timer;
+    this->clock = timer;
+    this->timer->attach(SmoothStepperCoordinator::staticTimerCallback, this);
+    this->wake();
+}
+
+unsigned long SmoothStepperCoordinator::staticCoordinatorTask(void *pvParameters, unsigned long now) {
+    SmoothStepperCoordinator *coordinator = reinterpret_cast<SmoothStepperCoordinator *>(pvParameters);
+    return coordinator->coordinatorTask(now);
+}
+
+/*
+ * One turn of the task loop.
+ * Return the date (us) of the next step.
+ */
+unsigned long SmoothStepperCoordinator::coordinatorTask(unsigned long now) {
+    this->poll(now);
+
+    if (this->isMoving()) {
+        return this->next_step;
+    }
+    return now + STEPPER_IDLE_SLEEP;  // Or until woken by a command
+}
+
+void SmoothStepperCoordinator::staticTimerCallback(void *arg) {
+    SmoothStepperCoordinator *coordinator = reinterpret_cast<SmoothStepperCoordinator *>(arg);
+    coordinator->timerCallback();
+}
+
+void SmoothStepperCoordinator::timerCallback() {
+    this->poll(this->clock->micros());
+
+    if (this->isMoving()) {
+        this->timer->armAt(this->next_step);
+        return;
+    }
+
+    // Going idle, a move sent meanwhile would not have armed the timer.
+    this->timer_running = false;
+    if (!this->moves.empty()) {
+        this->wake();
+    }
+}
+
+/*
+ * Arm the timer now if the timer engine is idle, or wake the task.
+ */
+void SmoothStepperCoordinator::wake() {
+    if (this->timer == nullptr) {
+        stepperWakeTask(&this->task);
+        return;
+    }
+    if (this->timer_running) return;
+
+    this->timer_running = true;
+    this->timer->armAt(this->clock->micros());
+}
+
+bool SmoothStepperCoordinator::accelerationEnable(float minSpeed, float maxSpeed, long rampTime) {
+    if (maxSpeed <= 0 || rampTime <= 0 || minSpeed <= 0) {
+        return false;
+    }
+    this->minSpeed = minSpeed;
+    this->maxSpeed = maxSpeed;
+    this->rampTime = rampTime;
+    return true;
+}
+
+bool SmoothStepperCoordinator::accelerationDisable(float speed) {
+    if (speed <= 0) {
+        return false;
+    }
+    this->minSpeed = speed;
+    this->maxSpeed = speed;
+    this->rampTime = 0;
+    return true;
+}
+
+bool SmoothStepperCoordinator::moveTo(const long *positions) {
+    return this->sendMove(positions, true);
+}
+
+bool SmoothStepperCoordinator::move(const long *steps) {
+    return this->sendMove(steps, false);
+}
+
+bool SmoothStepperCoordinator::dwell(unsigned long ms) {
+    Move move;
+    move.type = DWELL;
+    move.steps[0] = ms;
+    return this->sendMove(move);
+}
+
+bool SmoothStepperCoordinator::setHolding(bool holding) {
+    Move move;
+    move.type = HOLD;
+    move.steps[0] = holding ? 1 : 0;
+    return this->sendMove(move);
+}
+
+/*
+ * Give a move to the step loop, with the current speed settings.
+ * Return false when the move queue is full.
+ */
+bool SmoothStepperCoordinator::sendMove(const long *steps, bool absolute) {
+    Move move;
+    move.type = LINEAR;
+    for (int axis = 0; axis < this->count; axis++) {
+        move.steps[axis] = steps[axis];
+    }
+    move.absolute = absolute;
+    move.minSpeed = this->minSpeed;
+    move.maxSpeed = this->maxSpeed;
+    move.rampTime = this->rampTime;
+    return this->sendMove(move);
+}
+
+bool SmoothStepperCoordinator::sendMove(Move &move) {
+    if (!this->moves.push(move)) {
+        return false;
+    }
+    this->wake();
+    return true;
+}
+
+bool SmoothStepperCoordinator::isArrived() {
+    return this->remaining == 0 && !this->dwelling && this->moves.empty();
+}
+
+bool SmoothStepperCoordinator::waitUntilArrived(unsigned long timeout) {
+    StepperTimeout left(this->clock, timeout);
+    while (1) {
+        this->arrival.clear();
+        if (this->isArrived()) {
+            return true;
+        }
+
+        unsigned long wait = left.next();  // us
+        if (wait == 0) {
+            return false;
+        }
+        this->arrival.wait(wait);
+    }
+}
+
+/*
+ * Return true while there are steps to do.
+ */
+bool SmoothStepperCoordinator::isMoving() {
+    return this->remaining != 0 || this->dwelling || !this->moves.empty();
+}
+
+/*
+ * Take the next move which has steps to do and plan it, from the step loop.
+ * Return false when there is none, or when a dwell starts.
+ */
+bool SmoothStepperCoordinator::startMove(unsigned long now) {
+    Move move;
+    while (this->moves.peek(0, &move)) {
+        if (move.type == DWELL) {
+            this->next_step = now + (unsigned long)move.steps[0] * 1000;
+            this->dwelling = true;
+            this->chained = false;
+            this->moves.pop(&move);  // Only now, so that we never look arrived meanwhile.
+            return false;
+        }
+        if (move.type == HOLD) {
+            for (int axis = 0; axis < this->count; axis++) {
+                this->steppers[axis]->hold(move.steps[0] != 0);
+            }
+            this->batch.flush();
+            this->moves.pop(&move);
+            if (this->moves.empty()) this->arrival.notify();
+            continue;
+        }
+
+        int dominantAxis = 0;
+        this->dominant = 0;
+        for (int axis = 0; axis < this->count; axis++) {
+            SmoothStepper *stepper = this->steppers[axis];
+            long target = move.absolute ? move.steps[axis] : stepper->current_step + move.steps[axis];
+            long delta = target - stepper->current_step;
+
+            stepper->step_to_be = target;
+            stepper->direction = delta > 0 ? 1 : (delta < 0 ? -1 : 0);
+            this->deltas[axis] = delta < 0 ? -delta : delta;
+            if (this->deltas[axis] > this->dominant) {
+                this->dominant = this->deltas[axis];
+                dominantAxis = axis;
+            }
+        }
+        if (this->dominant == 0) {
+            this->moves.pop(&move);
+            if (this->moves.empty()) this->arrival.notify();  // Already there
+            continue;
+        }
+
+        for (int axis = 0; axis < this->count; axis++) {
+            this->errors[axis] = this->dominant / 2;
+        }
+
+        // One ramp for the dominant axis, the others follow it.
+        int number_of_steps = this->steppers[dominantAxis]->number_of_steps;
+        float vmin = move.minSpeed * number_of_steps / 60 / 1000;  // step/ms
+        float vmax = move.maxSpeed * number_of_steps / 60 / 1000;  // step/ms
+        float acc = move.rampTime > 0 ? (vmax - vmin) / move.rampTime : 0;  // step/ms²
+        this->ramp.configure(vmin, vmax, acc);
+        this->remaining = this->dominant;
+        this->moves.pop(&move);  // Only now, so that we never look arrived meanwhile.
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Do the step of all the axes if it's time to.
+ * Return true when a step was done.
+ */
+bool SmoothStepperCoordinator::poll(unsigned long now) {
+    if (this->dwelling) {
+        if ((long)(now - this->next_step) < 0) return false;
+        this->dwelling = false;
+        if (this->moves.empty()) this->arrival.notify();
+    }
+    if (this->remaining == 0) {
+        if (!this->startMove(now)) return false;
+        // All the axes start on this tick, or one start interval after the
+        // last step of the previous move when it just ended.
+        uint32_t interval = this->ramp.intervalMicros();
+        if (this->chained && now - this->last_step < interval) {
+            this->next_step = this->last_step + interval;
+        } else {
+            this->next_step = now;
+        }
+        this->chained = false;
+    }
+    if ((long)(now - this->next_step) < 0) {
+        return false;
+    }
+
+    // The dominant axis steps every time, the others when their error overflows.
+    for (int axis = 0; axis < this->count; axis++) {
+        this->errors[axis] -= this->deltas[axis];
+        if (this->errors[axis] < 0) {
+            this->errors[axis] += this->dominant;
+            SmoothStepper *stepper = this->steppers[axis];
+            stepper->doStep();
+            if (stepper->trace != nullptr) stepper->trace->step(now, stepper->direction, stepper->current_step);
+            stepper->last_step_time = now;
+        }
+    }
+    this->batch.flush();  // All the axes at once
+
+    this->remaining--;
+    if (this->remaining == 0) {
+        this->last_step = now;
+        this->chained = true;
+        for (int axis = 0; axis < this->count; axis++) {
+            this->steppers[axis]->direction = 0;
+            this->steppers[axis]->publish();
+        }
+        if (this->moves.empty()) {
+            this->arrival.notify();
+        }
+        return true;
+    }
+
+    if (this->remaining <= (long)this->ramp.stepsToVmin()) {
+        this->ramp.deccelerate();
+    } else {
+        this->ramp.accelerate();
+    }
+    uint32_t interval = this->ramp.intervalMicros();
+    this->next_step = now + interval;
+    for (int axis = 0; axis < this->count; axis++) {  // For snapshot(), at the speed of each axis
+        SmoothStepper *stepper = this->steppers[axis];
+        if (this->deltas[axis] > 0) stepper->step_interval = (uint64_t)interval * this->dominant / this->deltas[axis];
+        stepper->publish();
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+/*
+ * SmoothStepperCoordinator.h - Coordinated linear moves of several SmoothStepper motors.
+ *
+ * The axes of a move start on the same tick and arrive on the same tick,
+ * along a straight line: one speed ramp is planned for the dominant axis
+ * (the one with the most steps) and the steps of the other axes are
+ * distributed over its steps with Bresenham's line algorithm. All the axes
+ * are stepped from a single loop (a task or a timer).
+ *
+ * The axes must not be started with their own begin() nor added to a
+ * group, they are moved only through the coordinator.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperCoordinator_h
+#define SmoothStepperCoordinator_h
+
+#include "SmoothRamp.h"
+#include "SmoothStepper.h"
+#include "SmoothStepperHal.h"
+#include "SmoothStepperQueue.h"
+
+#ifndef SMOOTHSTEPPER_MAX_AXES
+#define SMOOTHSTEPPER_MAX_AXES 6  // Maximum number of axes of a coordinator
+#endif
+
+#ifndef SMOOTHSTEPPER_MOVE_QUEUE_SIZE
+#define SMOOTHSTEPPER_MOVE_QUEUE_SIZE 4  // Moves waiting for the step loop, power of 2
+#endif
+
+class SmoothStepperCoordinator {
+   public:
+    /**
+     * Add an axis, to call before begin().
+     * Return the index of the axis or -1 when there are already SMOOTHSTEPPER_MAX_AXES,
+     * or when its pins are not on the output (GPIO or StepperOutput) of the other axes.
+     * */
+    int add(SmoothStepper *stepper);
+
+    /**
+     * Step all the axes from one task, pinned to core 0 unless the config
+     * says otherwise (see SmoothStepper::begin()).
+     * */
+    void begin(const StepperTaskConfig &config = StepperTaskConfig());
+
+    /**
+     * Timer driven alternative to begin(): the timer is armed for the date
+     * of the next step. The timer must outlive the coordinator.
+     * */
+    void begin(StepperTimer *timer);
+
+    /**
+     * Speed of the dominant axis of the next moves
+     * - minSpeed (rev/min)
+     * - maxSpeed (rev/min)
+     * - rampTime (ms)
+     * */
+    bool accelerationEnable(float minSpeed, float maxSpeed, long rampTime);
+
+    /**
+     * Constant speed of the dominant axis of the next moves
+     * - speed (rev/min)
+     * */
+    bool accelerationDisable(float speed);
+
+    /**
+     * Move every axis to an absolute position, one per axis in the order of add().
+     * Queued for the step loop, return false when the queue is full.
+     * */
+    bool moveTo(const long *positions);
+
+    /**
+     * Move every axis by a number of steps, one per axis in the order of add().
+     * Queued for the step loop, return false when the queue is full.
+     * */
+    bool move(const long *steps);
+
+    /**
+     * Wait (ms) after the moves queued before, before the next ones.
+     * Queued for the step loop, return false when the queue is full.
+     * */
+    bool dwell(unsigned long ms);
+
+    /**
+     * Energize the coils of every axis at their phase (holding torque) or
+     * release them (no current), after the moves queued before. The next
+     * step energizes them again. No effect on STEP/DIR motors.
+     * Queued for the step loop, return false when the queue is full.
+     * */
+    bool setHolding(bool holding);
+
+    // Return true when every axis is arrived and no move is queued
+    bool isArrived();
+
+    /**
+     * Wait until every axis is arrived, blocked (no CPU used) until the
+     * step loop signals the end of the moves.
+     * Return false when still not arrived after timeout (ms).
+     * */
+    bool waitUntilArrived(unsigned long timeout = STEPPER_WAIT_FOREVER);
+
+    // Number of axes
+    int size() { return this->count; }
+
+   private:
+    friend class SmoothStepperBenchmark;
+    friend class SmoothStepperGcode;
+
+    enum MoveType { LINEAR, DWELL, HOLD };
+
+    struct Move {
+        uint8_t type;
+        long steps[SMOOTHSTEPPER_MAX_AXES];  // DWELL: steps[0] is the time (ms), HOLD: 1 to energize
+        bool absolute;
+        float minSpeed;  // rev/min
+        float maxSpeed;  // rev/min
+        long rampTime;   // ms, 0 for no acceleration
+    };
+
+    bool sendMove(const long *steps, bool absolute);
+    bool sendMove(Move &move);
+    bool startMove(unsigned long now);
+    bool poll(unsigned long now);
+    bool isMoving();
+    void wake();
+
+    static unsigned long staticCoordinatorTask(void *pvParameters, unsigned long now);
+    unsigned long coordinatorTask(unsigned long now);
+    static void staticTimerCallback(void *arg);
+    void timerCallback();
+
+    SmoothStepper *steppers[SMOOTHSTEPPER_MAX_AXES];
+    int count = 0;
+
+    // speed of the next moves (application side)
+    float minSpeed = 3;
+    float maxSpeed = 3;
+    long rampTime = 0;
+
+    // current move (step loop only)
+    long deltas[SMOOTHSTEPPER_MAX_AXES];  // Steps of each axis (absolute value)
+    long errors[SMOOTHSTEPPER_MAX_AXES];  // Bresenham error of each axis
+    long dominant = 0;                    // Steps of the dominant axis
+    volatile long remaining = 0;          // Steps of the dominant axis left
+    SmoothRamp ramp;                      // Speed ramp of the dominant axis
+    unsigned long next_step = 0;          // Date (us) of the next step, or of the end of a dwell
+    volatile bool dwelling = false;       // Until next_step
+    unsigned long last_step = 0;          // Date (us) of the last step of the previous move...
+    bool chained = false;                 // ...which the next move follows without a dwell
+    StepperPortBatch batch;               // Pins of the axes stepping on this tick
+    StepperSignal arrival;                // Notified at the end of the moves
+
+    // moves from the application to the step loop
+    StepperQueue<Move, SMOOTHSTEPPER_MOVE_QUEUE_SIZE> moves;
+
+    StepperTask task;
+
+    // clock and timer
+    StepperClock *clock = stepperDefaultClock();
+    StepperTimer *timer = nullptr;
+    volatile bool timer_running = false;
+};
+
+#endif
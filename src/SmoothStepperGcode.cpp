@@ -0,0 +1,336 @@
+/*
+ * SmoothStepperGcode.cpp - Streaming G-code interpreter for a SmoothStepperCoordinator.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothStepperGcode.h"
+
+#include <math.h>
+#include <string.h>
+
+#define GCODE_WORD(letter) (1UL << ((letter) - 'A'))
+
+static const char gcodeAxes[] = "XYZABC";
+
+SmoothStepperGcode::SmoothStepperGcode(SmoothStepperCoordinator *coordinator) {
+    this->coordinator = coordinator;
+    this->feed = this->rapid_speed;
+    this->resetBlock();
+}
+
+bool SmoothStepperGcode::accelerationEnable(float minSpeed, float rapidSpeed, long rampTime) {
+    if (minSpeed <= 0 || rapidSpeed < minSpeed || rampTime <= 0) {
+        return false;
+    }
+    this->min_speed = minSpeed;
+    this->rapid_speed = rapidSpeed;
+    this->ramp_time = rampTime;
+    if (this->feed > rapidSpeed) this->feed = rapidSpeed;
+    return true;
+}
+
+bool SmoothStepperGcode::setStepsPerUnit(float stepsPerUnit) {
+    if (stepsPerUnit <= 0) {
+        return false;
+    }
+    this->steps_per_unit = stepsPerUnit;
+    return true;
+}
+
+size_t SmoothStepperGcode::write(const char *text) {
+    return this->write(reinterpret_cast<const uint8_t *>(text), strlen(text));
+}
+
+size_t SmoothStepperGcode::write(const uint8_t *data, size_t length) {
+    if (this->pending && !this->execute()) {
+        return 0;  // Still no room
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (!this->parse((char)data[i])) {
+            return i + 1;  // The end of the line is consumed, the block waits.
+        }
+    }
+    return length;
+}
+
+bool SmoothStepperGcode::isIdle() {
+    return !this->pending && this->coordinator->isArrived();
+}
+
+/*
+ * Parse one byte.
+ * Return false when it ends a line which could not be queued.
+ */
+bool SmoothStepperGcode::parse(char c) {
+    if (c == '\n' || c == '\r') {
+        if (this->mode == CODE && !this->endWord()) this->malformed = true;
+        this->mode = CODE;
+        if (this->blank && !this->malformed) {
+            return true;  // Empty line
+        }
+        this->pending = true;
+        return this->execute();
+    }
+
+    if (this->mode == COMMENT) {
+        if (c == ')') this->mode = CODE;
+        return true;
+    }
+    if (this->mode == COMMENT_LINE) {
+        return true;
+    }
+
+    if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    if (c >= 'A' && c <= 'Z') {
+        if (!this->endWord()) this->malformed = true;
+        this->letter = c;
+    } else if (c >= '0' && c <= '9') {
+        this->digits = true;
+        if (this->mantissa < 100000000) {
+            this->mantissa = this->mantissa * 10 + (c - '0');
+            if (this->decimals >= 0) this->decimals++;
+        } else if (this->decimals < 0) {
+            this->malformed = true;  // Integer part too long, another value if cut
+        }  // Else a decimal below the precision of the value
+    } else if (c == '.' && this->decimals < 0) {
+        this->decimals = 0;
+    } else if ((c == '-' || c == '+') && !this->digits && this->decimals < 0) {
+        this->negative = c == '-';
+    } else if (c == ';' || c == '*') {  // Comment or checksum until the end of the line
+        if (!this->endWord()) this->malformed = true;
+        this->mode = COMMENT_LINE;
+    } else if (c == '(') {
+        if (!this->endWord()) this->malformed = true;
+        this->mode = COMMENT;
+    } else if (c != ' ' && c != '\t' && c != '%') {
+        this->malformed = true;
+    }
+    return true;
+}
+
+/*
+ * Store the word being parsed in the block.
+ * Return false when it is malformed.
+ */
+bool SmoothStepperGcode::endWord() {
+    float value = this->mantissa;
+    for (int8_t i = 0; i < this->decimals; i++) value /= 10;
+    if (this->negative) value = -value;
+    char letter = this->letter;
+    bool digits = this->digits;
+
+    this->letter = 0;
+    this->negative = false;
+    this->digits = false;
+    this->mantissa = 0;
+    this->decimals = -1;
+    if (letter == 0) return !digits;  // A number alone is malformed
+    if (!digits) return false;
+    this->blank = false;
+
+    if (letter == 'N') return true;  // Line number
+    if (letter == 'G' && (value == 90 || value == 91)) {
+        this->relative = value == 91;  // Modal, applies to the words of its line too
+        return true;
+    }
+    if (letter == 'G' && (value == 17 || value == 21 || value == 94)) {
+        return true;  // XY plane, millimeters, feed per minute: the only ones
+    }
+    if ((this->words & GCODE_WORD(letter)) != 0) {
+        return false;  // Twice in a block
+    }
+    this->words |= GCODE_WORD(letter);
+    this->values[letter - 'A'] = value;
+    return true;
+}
+
+void SmoothStepperGcode::resetBlock() {
+    this->words = 0;
+    this->blank = true;
+    this->malformed = false;
+    this->pending = false;
+}
+
+/*
+ * Execute the block of the line just ended.
+ * Return false when the move queue is full, the block is kept to execute
+ * again later, nothing of it applied yet.
+ */
+bool SmoothStepperGcode::execute() {
+    bool done = true;
+    bool valid = !this->malformed;
+
+    if (valid && (this->words & GCODE_WORD('F')) != 0) {
+        valid = this->values['F' - 'A'] > 0;
+    }
+
+    if (!valid) {
+    } else if ((this->words & GCODE_WORD('G')) != 0) {
+        float code = this->values['G' - 'A'];
+        if (code == 0 || code == 1) {
+            done = this->linear(code == 0);
+            if (done) this->rapid = code == 0;
+        } else if (code == 4) {
+            float ms = 0;
+            if ((this->words & GCODE_WORD('P')) != 0) ms = this->values['P' - 'A'];
+            if ((this->words & GCODE_WORD('S')) != 0) ms = this->values['S' - 'A'] * 1000;
+            done = ms <= 0 || this->coordinator->dwell((unsigned long)lroundf(ms));
+        } else if (code == 28) {
+            done = this->home();
+        } else if (code == 92) {
+            this->setPosition();
+        } else {
+            valid = false;
+        }
+    } else if ((this->words & GCODE_WORD('M')) != 0) {
+        float code = this->values['M' - 'A'];
+        if (code == 17) {
+            done = this->coordinator->setHolding(true);
+        } else if (code == 18 || code == 84) {
+            done = this->coordinator->setHolding(false);
+        } else if (code != 2 && code != 30) {
+            valid = false;
+        }
+    } else if ((this->words & ~(GCODE_WORD('F') | this->axisWords())) == 0) {
+        done = this->linear(this->rapid);  // Axis words alone: the last G0 or G1 again
+    } else {
+        valid = false;
+    }
+
+    if (!done) {
+        return false;
+    }
+    if (valid && (this->words & GCODE_WORD('F')) != 0) {
+        this->feed = this->values['F' - 'A'];
+        if (this->feed > this->rapid_speed) this->feed = this->rapid_speed;
+    }
+    if (valid) {
+        this->line_count++;
+    } else {
+        this->error_count++;
+    }
+    this->resetBlock();
+    return true;
+}
+
+/*
+ * Queue a linear move to the axis words of the block, at the rapid speed
+ * or the feed rate. Return false when the move queue is full.
+ */
+bool SmoothStepperGcode::linear(bool rapid) {
+    this->syncPosition();
+
+    long target[SMOOTHSTEPPER_MAX_AXES];
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        target[axis] = this->position[axis];
+        char letter = gcodeAxes[axis];
+        if ((this->words & GCODE_WORD(letter)) != 0) {
+            long steps = lroundf(this->values[letter - 'A'] * this->steps_per_unit);
+            target[axis] = this->relative ? target[axis] + steps : this->origin[axis] + steps;
+        }
+    }
+
+    float speed = this->feed;
+    if ((this->words & GCODE_WORD('F')) != 0) speed = this->values['F' - 'A'];
+    if (rapid || speed > this->rapid_speed) speed = this->rapid_speed;
+    return this->moveTo(target, speed);
+}
+
+/*
+ * G28: rapid move to the machine origin of the axis words of the block, or
+ * of every axis when there is none. Return false when the move queue is full.
+ */
+bool SmoothStepperGcode::home() {
+    this->syncPosition();
+
+    bool all = (this->words & this->axisWords()) == 0;
+
+    long target[SMOOTHSTEPPER_MAX_AXES];
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        bool homed = all || (this->words & GCODE_WORD(gcodeAxes[axis])) != 0;
+        target[axis] = homed ? 0 : this->position[axis];
+    }
+    return this->moveTo(target, this->rapid_speed);
+}
+
+/*
+ * G92: the current position of the axis words of the block becomes their
+ * value, of every axis becomes 0 when there is none.
+ */
+void SmoothStepperGcode::setPosition() {
+    this->syncPosition();
+
+    bool all = (this->words & this->axisWords()) == 0;
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        char letter = gcodeAxes[axis];
+        if (!all && (this->words & GCODE_WORD(letter)) == 0) continue;
+
+        float value = all ? 0 : this->values[letter - 'A'];
+        this->origin[axis] = this->position[axis] - lroundf(value * this->steps_per_unit);
+    }
+}
+
+// Words of the axes of the coordinator
+uint32_t SmoothStepperGcode::axisWords() {
+    uint32_t words = 0;
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        words |= GCODE_WORD(gcodeAxes[axis]);
+    }
+    return words;
+}
+
+/*
+ * Take the position of the axes when they were moved by others than the
+ * interpreter meanwhile: only at standstill, else it is the end of the
+ * moves queued.
+ */
+void SmoothStepperGcode::syncPosition() {
+    if (!this->coordinator->isArrived()) return;
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        this->position[axis] = this->coordinator->steppers[axis]->current_step;
+    }
+}
+
+/*
+ * Queue a move to target (machine steps) at speed (units/min) on its path.
+ * Return false when the move queue is full.
+ */
+bool SmoothStepperGcode::moveTo(const long *target, float speed) {
+    double length = 0;  // Of the path (steps)
+    long dominant = 0;
+    int dominantAxis = 0;
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        long delta = labs(target[axis] - this->position[axis]);
+        length += (double)delta * delta;
+        if (delta > dominant) {
+            dominant = delta;
+            dominantAxis = axis;
+        }
+    }
+    if (dominant == 0) {
+        return true;
+    }
+
+    // The speeds are on the path, the coordinator's of the dominant axis (rev/min).
+    float scale = this->steps_per_unit * dominant / sqrt(length) /
+                  this->coordinator->steppers[dominantAxis]->number_of_steps;
+    if (speed <= this->min_speed) {
+        this->coordinator->accelerationDisable(speed * scale);
+    } else {
+        // Same acceleration as from min_speed to rapid_speed in ramp_time
+        long rampTime = lroundf(this->ramp_time * (speed - this->min_speed) / (this->rapid_speed - this->min_speed));
+        this->coordinator->accelerationEnable(this->min_speed * scale, speed * scale, rampTime > 0 ? rampTime : 1);
+    }
+    if (!this->coordinator->moveTo(target)) {
+        return false;
+    }
+
+    for (int axis = 0; axis < this->coordinator->size(); axis++) {
+        this->position[axis] = target[axis];
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+/*
+ * SmoothStepperGcode.h - Streaming G-code interpreter for a SmoothStepperCoordinator.
+ *
+ * Bytes are parsed as they come, from any stream (serial, file, socket),
+ * without a line buffer: each line is a block, executed at its end by
+ * queuing a move in the coordinator. The coordinator plans and steps the
+ * current move while the next blocks are parsed and wait in its move
+ * queue, so that a move starts on the tick after the end of the previous
+ * one instead of waiting for the next line.
+ *
+ * Supported:
+ *   G0, G1       linear move (G0 at the rapid speed, G1 at the feed rate F)
+ *   G4 P<ms>     dwell (or S<s>)
+ *   G28          go to the machine origin (of the given axes, or all)
+ *   G90, G91     absolute / relative coordinates
+ *   G92          set the current position of the given axes
+ *   M17          energize the coils of every axis
+ *   M18, M84     release the coils of every axis
+ *   M2, M30      end of program, ignored
+ * Words X, Y, Z, A, B, C are the axes in the order of add() to the
+ * coordinator. ';' and '(...)' are comments, N and '*' are ignored.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperGcode_h
+#define SmoothStepperGcode_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SmoothStepperCoordinator.h"
+
+class SmoothStepperGcode {
+   public:
+    explicit SmoothStepperGcode(SmoothStepperCoordinator *coordinator);
+
+    /**
+     * Speed of the moves, on their path
+     * - minSpeed (units/min): start and end of every move
+     * - rapidSpeed (units/min): of G0, and the most for G1
+     * - rampTime (ms): from minSpeed to rapidSpeed, the acceleration is the
+     *   same for the slower feed rates of G1
+     * */
+    bool accelerationEnable(float minSpeed, float rapidSpeed, long rampTime);
+
+    /**
+     * Steps of every axis per unit of the coordinates and of the speeds,
+     * 1 by default (the coordinates are steps).
+     * */
+    bool setStepsPerUnit(float stepsPerUnit);
+
+    /**
+     * Parse the bytes and execute each complete line.
+     * Return the number of bytes consumed: less than length when the move
+     * queue of the coordinator is full, the rest is to write again later.
+     * The line waiting for room is executed by the next write(), even of
+     * no byte.
+     * */
+    size_t write(const uint8_t *data, size_t length);
+    size_t write(const char *text);
+
+    // Return true when every block is executed and every axis is arrived
+    bool isIdle();
+
+    // Lines executed / rejected (unknown code, malformed word, more than 9 digits before the point)
+    unsigned long lines() { return this->line_count; }
+    unsigned long errors() { return this->error_count; }
+
+   private:
+    bool parse(char c);
+    bool endWord();
+    bool execute();
+    bool linear(bool rapid);
+    bool home();
+    void setPosition();
+    uint32_t axisWords();
+    void syncPosition();
+    bool moveTo(const long *target, float speed);
+    void resetBlock();
+
+    SmoothStepperCoordinator *coordinator;
+
+    // settings
+    float min_speed = 60;     // units/min
+    float rapid_speed = 600;  // units/min
+    long ramp_time = 500;     // ms, from min_speed to rapid_speed
+    float steps_per_unit = 1;
+
+    // modal state
+    bool relative = false;                      // G91
+    bool rapid = false;                         // G0, else G1
+    float feed = 0;                             // units/min, rapid_speed until the first F
+    long position[SMOOTHSTEPPER_MAX_AXES] = {};  // Machine (steps), at the end of the queued moves
+    long origin[SMOOTHSTEPPER_MAX_AXES] = {};    // Machine position of the coordinate 0 (G92)
+
+    // current word
+    char letter = 0;
+    bool negative = false;
+    bool digits = false;  // Some seen
+    long mantissa = 0;
+    int8_t decimals = -1;  // After the point, -1 before it
+    enum { CODE, COMMENT_LINE, COMMENT } mode = CODE;
+
+    // current block
+    uint32_t words = 0;  // Letters seen, bit 0 for 'A'
+    float values[26];
+    bool blank = true;  // No word yet
+    bool malformed = false;
+    bool pending = false;  // Complete, waiting for room in the move queue
+
+    unsigned long line_count = 0;
+    unsigned long error_count = 0;
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * SmoothStepperGroup.cpp - One scheduler for several SmoothStepper motors.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothStepperGroup.h"
+
+int SmoothStepperGroup::add(SmoothStepper *stepper) {
+    if (this->count == SMOOTHSTEPPER_GROUP_SIZE) return -1;
+    if (stepper->phase_masks != nullptr) {  // Coil pins: one output for the whole group
+        for (int motor = 0; motor < this->count; motor++) {
+            SmoothStepper *other = this->steppers[motor];
+            if (other->phase_masks != nullptr && other->output != stepper->output) return -1;
+        }
+        this->batch.output = stepper->output;
+    }
+
+    int motor = this->count++;
+    this->steppers[motor] = stepper;
+    this->misses[motor] = 0;
+    this->lateness[motor] = 0;
+    this->idle[motor] = true;
+    stepper->group = this;
+    stepper->batch = &this->batch;
+    stepper->started = true;
+    return motor;
+}
+
+void SmoothStepperGroup::begin(const StepperTaskConfig &config) {
+    for (int motor = 0; motor < this->count; motor++) {
+        this->steppers[motor]->calculStrategy();
+    }
+    this->woken = true;
+
+    this->task.service = SmoothStepperGroup::staticGroupTask;
+    this->task.arg = this;
+    this->task.name = "stepperGroup";
+    stepperStartTask(&this->task, config);
+}
+
+void SmoothStepperGroup::begin(StepperTimer *timer) {
+    this->timer = timer;
+    this->clock = timer;
+    this->timer->attach(SmoothStepperGroup::staticTimerCallback, this);
+    for (int motor = 0; motor < this->count; motor++) {
+        this->steppers[motor]->calculStrategy();
+    }
+    this->wake();
+}
+
+unsigned long SmoothStepperGroup::staticGroupTask(void *pvParameters, unsigned long now) {
+    SmoothStepperGroup *group = reinterpret_cast<SmoothStepperGroup *>(pvParameters);
+    return group->groupTask(now);
+}
+
+/*
+ * One turn of the task loop.
+ * Return the date (us) of the next step.
+ */
+unsigned long SmoothStepperGroup::groupTask(unsigned long now) {
+    this->poll(now);
+
+    if (this->heap_size > 0) {
+        return this->deadlines[this->heap[0]];
+    }
+    return now + STEPPER_IDLE_SLEEP;  // Or until woken by a command
+}
+
+void SmoothStepperGroup::staticTimerCallback(void *arg) {
+    SmoothStepperGroup *group = reinterpret_cast<SmoothStepperGroup *>(arg);
+    group->timerCallback();
+}
+
+void SmoothStepperGroup::timerCallback() {
+    this->poll(this->clock->micros());
+
+    if (this->heap_size > 0) {
+        this->timer->armAt(this->deadlines[this->heap[0]]);
+        return;
+    }
+
+    // Going idle, a motor woken meanwhile would not have armed the timer.
+    this->timer_running = false;
+    if (this->woken) {
+        this->wake();
+    }
+}
+
+/*
+ * Called by the motors when they get new steps.
+ */
+void SmoothStepperGroup::wake() {
+    this->woken = true;
+    if (this->timer == nullptr) {
+        stepperWakeTask(&this->task);
+        return;
+    }
+    if (this->timer_running) return;
+
+    this->timer_running = true;
+    this->timer->armAt(this->clock->micros());
+}
+
+/*
+ * Do the steps due at now, in deadline order.
+ */
+void SmoothStepperGroup::poll(unsigned long now) {
+    if (this->woken) {
+        this->woken = false;
+        this->wakeIdleMotors(now);
+    }
+
+    // The pins of the motors stepping at the same date are written at once.
+    unsigned long batch_deadline = 0;
+    while (this->heap_size > 0) {
+        uint8_t motor = this->heap[0];
+        unsigned long deadline = this->deadlines[motor];
+        if ((long)(now - deadline) < 0) break;
+        if (deadline != batch_deadline) {
+            this->batch.flush();
+            batch_deadline = deadline;
+        }
+
+        // A late step restarts the schedule from now to avoid a burst of steps.
+        unsigned long late = now - deadline;
+        if (late > this->lateness[motor]) this->lateness[motor] = late;
+        if (late > this->missTolerance) {
+            this->misses[motor]++;
+            deadline = now;
+        }
+
+        SmoothStepper *stepper = this->steppers[motor];
+        stepper->poll(deadline);
+
+        if (stepper->isMoving()) {
+            this->deadlines[motor] = stepper->nextStepTime();
+            this->siftDown(0);
+        } else {
+            this->idle[motor] = true;
+            this->heap[0] = this->heap[--this->heap_size];
+            this->siftDown(0);
+        }
+    }
+    this->batch.flush();
+}
+
+/*
+ * Put the idle motors which got new steps back in the heap.
+ */
+void SmoothStepperGroup::wakeIdleMotors(unsigned long now) {
+    for (int motor = 0; motor < this->count; motor++) {
+        if (!this->idle[motor] || !this->steppers[motor]->isMoving()) continue;
+
+        unsigned long deadline = this->steppers[motor]->nextStepTime();
+        if ((long)(deadline - now) < 0) {
+            deadline = now;
+        }
+        this->idle[motor] = false;
+        this->push(motor, deadline);
+    }
+}
+
+void SmoothStepperGroup::push(uint8_t motor, unsigned long deadline) {
+    this->deadlines[motor] = deadline;
+    this->heap[this->heap_size] = motor;
+    this->siftUp(this->heap_size++);
+}
+
+void SmoothStepperGroup::siftDown(int position) {
+    while (1) {
+        int smallest = position;
+        int left = 2 * position + 1;
+        int right = left + 1;
+        if (left < this->heap_size &&
+            (long)(this->deadlines[this->heap[left]] - this->deadlines[this->heap[smallest]]) < 0) {
+            smallest = left;
+        }
+        if (right < this->heap_size &&
+            (long)(this->deadlines[this->heap[right]] - this->deadlines[this->heap[smallest]]) < 0) {
+            smallest = right;
+        }
+        if (smallest == position) return;
+
+        uint8_t motor = this->heap[position];
+        this->heap[position] = this->heap[smallest];
+        this->heap[smallest] = motor;
+        position = smallest;
+    }
+}
+
+void SmoothStepperGroup::siftUp(int position) {
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if ((long)(this->deadlines[this->heap[position]] - this->deadlines[this->heap[parent]]) >= 0) return;
+
+        uint8_t motor = this->heap[position];
+        this->heap[position] = this->heap[parent];
+        this->heap[parent] = motor;
+        position = parent;
+    }
+}
+
+/*
+ * Wait for each motor in turn, within the same timeout (ms).
+ */
+bool SmoothStepperGroup::waitAll(unsigned long timeout) {
+    StepperTimeout left(this->clock, timeout);
+    for (int motor = 0; motor < this->count; motor++) {
+        if (!this->steppers[motor]->waitUntilArrived(left.leftMillis())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SmoothStepperGroup::setMissTolerance(unsigned long tolerance) {
+    this->missTolerance = tolerance;
+}
+
+unsigned long SmoothStepperGroup::deadlineMisses(int motor) {
+    return this->misses[motor];
+}
+
+unsigned long SmoothStepperGroup::maxLateness(int motor) {
+    return this->lateness[motor];
+}
+
+void SmoothStepperGroup::resetStats() {
+    for (int motor = 0; motor < this->count; motor++) {
+        this->misses[motor] = 0;
+        this->lateness[motor] = 0;
+    }
+}
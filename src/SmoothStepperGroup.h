@@ -0,0 +1,111 @@
+/*
+ * SmoothStepperGroup.h - One scheduler for several SmoothStepper motors.
+ *
+ * Instead of one busy task per motor, the group services all its motors
+ * from a single loop (a task or a timer), taking the motors in the order
+ * of their next step date thanks to a min-heap: a step costs O(log N)
+ * whatever the number of motors. Late steps are counted per motor.
+ *
+ * The motors of a group must not be started with their own begin().
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperGroup_h
+#define SmoothStepperGroup_h
+
+#include <stdint.h>
+
+#include "SmoothStepper.h"
+#include "SmoothStepperHal.h"
+
+#ifndef SMOOTHSTEPPER_GROUP_SIZE
+#define SMOOTHSTEPPER_GROUP_SIZE 16  // Maximum number of motors in a group
+#endif
+
+class SmoothStepperGroup {
+   public:
+    /**
+     * Add a motor, to call before begin().
+     * Return the index of the motor in the group or -1 when the group is full.
+     * The coil pins of all the motors are written at once, so they must all
+     * be GPIO or all outputs of the same StepperOutput (-1 otherwise).
+     * */
+    int add(SmoothStepper *stepper);
+
+    /**
+     * Service all the motors from one task, pinned to core 0 unless the
+     * config says otherwise (see SmoothStepper::begin()).
+     * */
+    void begin(const StepperTaskConfig &config = StepperTaskConfig());
+
+    /**
+     * Timer driven alternative to begin(): the timer is armed for the date
+     * of the next step of any motor. The timer must outlive the group.
+     * */
+    void begin(StepperTimer *timer);
+
+    /**
+     * A step later than tolerance (us) after its date is a deadline miss.
+     * */
+    void setMissTolerance(unsigned long tolerance);
+
+    // Number of deadline misses of a motor
+    unsigned long deadlineMisses(int motor);
+
+    // Worst lateness (us) of a motor
+    unsigned long maxLateness(int motor);
+
+    // Clear the deadline misses and the lateness of all motors
+    void resetStats();
+
+    /**
+     * Wait until every motor of the group is arrived, blocked like
+     * SmoothStepper::waitUntilArrived().
+     * Return false when they are still not all arrived after timeout (ms).
+     * */
+    bool waitAll(unsigned long timeout = STEPPER_WAIT_FOREVER);
+
+    // Number of motors in the group
+    int size() { return this->count; }
+
+    // Called by the motors when they get new steps
+    void wake();
+
+   private:
+    friend class SmoothStepperBenchmark;
+
+    void poll(unsigned long now);
+    void wakeIdleMotors(unsigned long now);
+    void push(uint8_t motor, unsigned long deadline);
+    void siftDown(int position);
+    void siftUp(int position);
+
+    static unsigned long staticGroupTask(void *pvParameters, unsigned long now);
+    unsigned long groupTask(unsigned long now);
+    static void staticTimerCallback(void *arg);
+    void timerCallback();
+
+    SmoothStepper *steppers[SMOOTHSTEPPER_GROUP_SIZE];
+    unsigned long deadlines[SMOOTHSTEPPER_GROUP_SIZE];  // Next step date (us)
+    unsigned long misses[SMOOTHSTEPPER_GROUP_SIZE];     // Deadline misses
+    unsigned long lateness[SMOOTHSTEPPER_GROUP_SIZE];   // Worst lateness (us)
+    bool idle[SMOOTHSTEPPER_GROUP_SIZE];                // Motor not in the heap
+    uint8_t heap[SMOOTHSTEPPER_GROUP_SIZE];             // Moving motors by deadline
+    int heap_size = 0;
+    int count = 0;
+    unsigned long missTolerance = 10;  // us
+
+    volatile bool woken = false;  // New steps for an idle motor
+    StepperPortBatch batch;       // Pins of the motors stepping at the same date
+    StepperTask task;
+
+    // clock and timer
+    StepperClock *clock = stepperDefaultClock();
+    StepperTimer *timer = nullptr;
+    volatile bool timer_running = false;
+};
+
+#endif
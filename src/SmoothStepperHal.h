@@ -0,0 +1,384 @@
+/*
+ * SmoothStepperHal.h - Hardware abstraction for the SmoothStepper library.
+ *
+ * Everything the library needs from the board: a microsecond clock, one
+ * shot timers, output pins and a task running the step loop.
+ * The ESP32 backend lives in SmoothStepperHalEsp32.cpp, a deterministic
+ * virtual time backend for host (Linux) builds lives in extras/simulator.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperHal_h
+#define SmoothStepperHal_h
+
+#include <stdint.h>
+
+// Busy waiting loops check again at most this late (us)
+#define STEPPER_IDLE_POLL 1000
+
+// An idle task sleeps until woken by stepperWakeTask(), or at most this long (us)
+#define STEPPER_IDLE_SLEEP 100000
+
+// A task sleeps for the coarse part of a wait and spins this long (us) before the date
+#ifndef STEPPER_SPIN_TIME
+#define STEPPER_SPIN_TIME 50
+#endif
+
+// Wait without timeout
+#define STEPPER_WAIT_FOREVER ((unsigned long)-1)
+
+// Longest single wait (us) of a timeout, below the rollover of the 32 bit clock
+#define STEPPER_WAIT_CHUNK 3600000000UL
+
+// Most STEP pulses in one chunk of a pulse generator
+#ifndef STEPPER_PULSE_CHUNK
+#define STEPPER_PULSE_CHUNK 64
+#endif
+
+// A chunk is cut once it lasts this long (us): the latency of a new command
+#ifndef STEPPER_PULSE_CHUNK_TIME
+#define STEPPER_PULSE_CHUNK_TIME 20000
+#endif
+
+// Default stack (bytes) of the step tasks
+#ifndef STEPPER_TASK_STACK
+#define STEPPER_TASK_STACK 2000
+#endif
+
+// Bytes of the control block of a task kept by the application (StaticTask_t on ESP32)
+#ifndef STEPPER_TASK_CONTROL_SIZE
+#define STEPPER_TASK_CONTROL_SIZE 384
+#endif
+
+// Set of output pins, bit n is pin n
+typedef uint64_t StepperPinMask;
+
+/*
+ * Microsecond clock.
+ */
+class StepperClock {
+   public:
+    virtual ~StepperClock() {}
+
+    // Return the time (us), rolls over like micros()
+    virtual unsigned long micros() = 0;
+};
+
+/*
+ * Timeout (ms) of a wait, up to STEPPER_WAIT_FOREVER - 1: the time waited
+ * is summed at each check in 64 bits, so a long timeout neither wraps when
+ * converted to us nor when the clock rolls over (71 minutes on a 32 bit
+ * board).
+ */
+class StepperTimeout {
+   public:
+    StepperTimeout(StepperClock *clock, unsigned long timeout) : clock(clock), last(clock->micros()) {
+        this->forever = timeout == STEPPER_WAIT_FOREVER;
+        this->left = (uint64_t)timeout * 1000;
+    }
+
+    // Time left (us) for the next wait: STEPPER_WAIT_FOREVER without timeout,
+    // 0 once expired, at most STEPPER_WAIT_CHUNK (check again after it)
+    unsigned long next() {
+        if (this->forever) return STEPPER_WAIT_FOREVER;
+        this->update();
+        return this->left < STEPPER_WAIT_CHUNK ? (unsigned long)this->left : STEPPER_WAIT_CHUNK;
+    }
+
+    // Time left (ms), rounded up, for a wait taking a timeout
+    unsigned long leftMillis() {
+        if (this->forever) return STEPPER_WAIT_FOREVER;
+        this->update();
+        uint64_t ms = (this->left + 999) / 1000;
+        return ms < STEPPER_WAIT_FOREVER ? (unsigned long)ms : STEPPER_WAIT_FOREVER - 1;
+    }
+
+   private:
+    void update() {
+        unsigned long now = this->clock->micros();
+        unsigned long elapsed = now - this->last;  // Checked more often than the rollover
+        this->last = now;
+        this->left = this->left > elapsed ? this->left - elapsed : 0;
+    }
+
+    StepperClock *clock;
+    unsigned long last;  // Date (us) of the last check
+    uint64_t left;       // us
+    bool forever;
+};
+
+/*
+ * One shot timer.
+ * The attached callback is called once when the armed date is reached.
+ */
+class StepperTimer : public StepperClock {
+   public:
+    typedef void (*Callback)(void *arg);
+
+    // Set the function to call when the timer fires
+    virtual void attach(Callback callback, void *arg) = 0;
+
+    // Fire once at date (us), a date in the past fires as soon as possible.
+    // Arming again replaces the previous date.
+    virtual void armAt(unsigned long date) = 0;
+
+    // Cancel the armed date
+    virtual void disarm() = 0;
+};
+
+/*
+ * One shot timer of the board: esp_timer on ESP32, virtual time on host
+ * builds. Use one instance per motor (or per group).
+ */
+class BoardStepperTimer : public StepperTimer {
+   public:
+    BoardStepperTimer();
+    ~BoardStepperTimer();
+
+    unsigned long micros();
+    void attach(Callback callback, void *arg);
+    void armAt(unsigned long date);
+    void disarm();
+
+   private:
+    static void fire(void *arg);
+
+    void *handle = nullptr;  // Backend timer
+    Callback callback = nullptr;
+    void *arg = nullptr;
+};
+
+struct StepperTask;
+
+/*
+ * STEP/DIR pulse generator: plays chunks of STEP pulses on its own while
+ * the CPU plans the next chunk. It owns two chunk buffers: one playing and
+ * one filled then queued behind it, started without a gap.
+ */
+class StepperPulseGenerator {
+   public:
+    virtual ~StepperPulseGenerator() {}
+
+    // Task woken each time a chunk is done
+    virtual void attach(StepperTask *task) = 0;
+
+    // Buffer for the next chunk (STEPPER_PULSE_CHUNK intervals), nullptr
+    // while both chunks are in use
+    virtual uint32_t *nextChunk() = 0;
+
+    // Play the chunk filled in nextChunk(): before pulse i wait intervals[i]
+    // (us) after the previous pulse, DIR set for direction (1 or -1)
+    virtual void queue(int count, int direction) = 0;
+
+    // Chunks playing or queued (0, 1 or 2)
+    virtual int pending() = 0;
+};
+
+/*
+ * Pulse generator of the board: two RMT channels on ESP32 (up to 4
+ * generators on the ESP32, 2 on the S2 and S3, 1 on the C3), recorded on
+ * virtual time on host builds.
+ */
+class BoardPulseGenerator : public StepperPulseGenerator {
+   public:
+    BoardPulseGenerator(int step_pin, int dir_pin);
+    ~BoardPulseGenerator();
+
+    // Setup the generator, before the motor's begin(): return false when
+    // no RMT channel is left or its driver cannot be installed
+    bool begin();
+
+    void attach(StepperTask *task);
+    uint32_t *nextChunk();
+    void queue(int count, int direction);
+    int pending();
+
+   private:
+    void *handle = nullptr;  // Backend generator
+    int step_pin;
+    int dir_pin;
+};
+
+/*
+ * Event signaled by the step loop and waited for by the application
+ * without using the CPU: a FreeRTOS event group on ESP32, on host builds
+ * the virtual clock runs until it is signaled.
+ * The waiter clears it, checks its condition then waits, so that a
+ * notify() in between is not lost.
+ */
+class StepperSignal {
+   public:
+    StepperSignal();
+    ~StepperSignal();
+
+    // Forget the previous notify()
+    void clear();
+
+    // Wake the waiting tasks
+    void notify();
+
+    // Wait for notify() at most timeout (us), return false on timeout
+    bool wait(unsigned long timeout);
+
+   private:
+    void *handle = nullptr;  // Backend event
+};
+
+/*
+ * Step loop run by a task.
+ * The service is called again and again with the current time (us) and
+ * returns the date (us) it needs to be called again at. Until then the
+ * task sleeps, unless woken by stepperWakeTask().
+ */
+typedef unsigned long (*StepperService)(void *arg, unsigned long now);
+
+struct StepperTask {
+    StepperService service;
+    void *arg;
+    const char *name;
+    void *handle = nullptr;  // Backend task, set by stepperStartTask()
+    void *alarm = nullptr;   // Backend timer ending the sleep of the task
+};
+
+/*
+ * Where a step task runs, given to begin().
+ * With a stack and a control block kept by the application the task is
+ * created without heap (xTaskCreateStatic on ESP32).
+ */
+struct StepperTaskConfig {
+    int core = 0;                              // Pinned to, -1 for any
+    unsigned priority = 1;
+    uint32_t stack_size = STEPPER_TASK_STACK;  // bytes
+    void *stack = nullptr;                     // stack_size bytes, or nullptr from the heap
+    void *control = nullptr;                   // STEPPER_TASK_CONTROL_SIZE bytes, with stack
+    const char *name = nullptr;                // Of the task, the library's when nullptr
+};
+
+/*
+ * Memory of a step task, static or global like the motor:
+ *   StepperTaskMemory<1536> memory;
+ *   motor.begin(memory.config());
+ */
+template <uint32_t StackSize>
+struct StepperTaskMemory {
+    alignas(16) uint8_t stack[StackSize];
+    alignas(16) uint8_t control[STEPPER_TASK_CONTROL_SIZE];
+
+    StepperTaskConfig config(int core = 0, unsigned priority = 1) {
+        StepperTaskConfig config;
+        config.core = core;
+        config.priority = priority;
+        config.stack_size = StackSize;
+        config.stack = this->stack;
+        config.control = this->control;
+        return config;
+    }
+};
+
+// Clock of the board, used when no timer is given
+StepperClock *stepperDefaultClock();
+
+// Set a pin as output
+void stepperPinOutput(int pin);
+
+// Write a pin (0 or 1)
+void stepperPinWrite(int pin, int value);
+
+// Set the pins of set and clear the pins of clear, with one register
+// write each when the board allows it
+void stepperPortWrite(StepperPinMask set, StepperPinMask clear);
+
+/*
+ * Outputs driven through a peripheral instead of the GPIO of the board,
+ * like a chain of shift registers. Bit n of the masks is output n.
+ */
+class StepperOutput {
+   public:
+    virtual ~StepperOutput() {}
+
+    // Set the outputs of set and clear the outputs of clear, at once
+    virtual void write(StepperPinMask set, StepperPinMask clear) = 0;
+};
+
+/*
+ * Daisy-chained 74HC595 shift registers written over SPI: DATA on SER of
+ * the first register, CLOCK on the SRCLK of all, LATCH on the RCLK of all.
+ * Output n is Q(n % 8) of register n / 8, register 0 being the one wired
+ * to the board. A write() shifts the whole frame in one transfer, the
+ * last register first, and latches it: all the outputs change at once.
+ * A write that changes no output is not sent.
+ * SPI2 with DMA on ESP32, on host builds the transfers are recorded
+ * (extras/simulator/Simulator.h).
+ */
+class BoardShiftRegister : public StepperOutput {
+   public:
+    // registers: in the chain, 1 to 8; frequency: of the SPI clock (Hz)
+    BoardShiftRegister(int registers, int data_pin, int clock_pin, int latch_pin,
+                       uint32_t frequency = 10000000);
+    ~BoardShiftRegister();
+
+    // Setup the SPI bus and clear all the outputs, return false when the bus cannot be used
+    bool begin();
+
+    void write(StepperPinMask set, StepperPinMask clear);
+
+    // Outputs high in the last frame
+    StepperPinMask frame() const { return this->bits; }
+
+    // Frames sent since begin()
+    unsigned long transfers() const { return this->transfer_count; }
+
+   private:
+    // Shift the frame out and latch it
+    void send();
+
+    void *handle = nullptr;  // Backend SPI device
+    int registers;
+    int data_pin;
+    int clock_pin;
+    int latch_pin;
+    uint32_t frequency;
+    StepperPinMask bits = 0;
+    volatile unsigned long transfer_count = 0;
+};
+
+/*
+ * Pin changes of several motors collected and written at once.
+ */
+struct StepperPortBatch {
+    StepperPinMask set = 0;
+    StepperPinMask clear = 0;
+    StepperOutput *output = nullptr;  // Written to, the GPIO of the board when nullptr
+
+    // The last change of a pin wins
+    void add(StepperPinMask set, StepperPinMask clear) {
+        this->set = (this->set & ~clear) | set;
+        this->clear = (this->clear & ~set) | clear;
+    }
+
+    // Write the collected changes with one stepperPortWrite(), or one write of the output
+    void flush() {
+        if ((this->set | this->clear) == 0) return;
+        if (this->output != nullptr) {
+            this->output->write(this->set, this->clear);
+        } else {
+            stepperPortWrite(this->set, this->clear);
+        }
+        this->set = 0;
+        this->clear = 0;
+    }
+};
+
+// Start a task running the service forever, task must stay valid
+void stepperStartTask(StepperTask *task, const StepperTaskConfig &config = StepperTaskConfig());
+
+// Call the service of a sleeping task now, nothing if it is not started
+void stepperWakeTask(StepperTask *task);
+
+// Called by the busy waiting loops of the library
+void stepperYield();
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * SmoothStepperHalEsp32.cpp - ESP32 backend of the SmoothStepper HAL.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#if defined(ARDUINO_ARCH_ESP32)
+
+#include "SmoothStepperHal.h"
+
+#include "Arduino.h"
+#include "driver/rmt.h"
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "soc/gpio_reg.h"
+
+/*
+ * Clock of the board: micros()
+ */
+class ArduinoStepperClock : public StepperClock {
+   public:
+    unsigned long micros() { return ::micros(); }
+};
+
+StepperClock *stepperDefaultClock() {
+    static ArduinoStepperClock clock;
+    return &clock;
+}
+
+void stepperPinOutput(int pin) { pinMode(pin, OUTPUT); }
+
+void stepperPinWrite(int pin, int value) { digitalWrite(pin, value ? HIGH : LOW); }
+
+/*
+ * The W1TS/W1TC registers only change the bits written to 1:
+ * no read-modify-write, no pin lookup.
+ */
+void stepperPortWrite(StepperPinMask set, StepperPinMask clear) {
+    if ((uint32_t)set) REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)set);
+    if ((uint32_t)clear) REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)clear);
+#ifdef GPIO_OUT1_W1TS_REG  // Pins 32 and more
+    if (set >> 32) REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(set >> 32));
+    if (clear >> 32) REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(clear >> 32));
+#endif
+}
+
+/*
+ * Call the service at the dates it asks for: the task blocks until its
+ * alarm (an esp_timer, finer than the RTOS tick) notifies it
+ * STEPPER_SPIN_TIME us before the date, then spins to be on time.
+ * A notification from stepperWakeTask() ends the sleep early.
+ */
+static void stepperTaskLoop(void *pvParameters) {
+    StepperTask *task = reinterpret_cast<StepperTask *>(pvParameters);
+    esp_timer_handle_t alarm = (esp_timer_handle_t)task->alarm;
+    while (1) {
+        unsigned long next = task->service(task->arg, ::micros());
+
+        long sleep = (long)(next - ::micros()) - STEPPER_SPIN_TIME;
+        if (sleep > 0) {
+            esp_timer_start_once(alarm, sleep);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            esp_timer_stop(alarm);
+            if ((long)(next - ::micros()) > STEPPER_SPIN_TIME) {
+                continue;  // Woken by new commands
+            }
+        }
+        while ((long)(next - ::micros()) > 0) {
+        }
+    }
+}
+
+/*
+ * The alarm only notifies the task: where the IDF allows it, it runs in the
+ * timer interrupt instead of waiting for the esp_timer task, which other
+ * timers and Wi-Fi can keep busy for longer than STEPPER_SPIN_TIME.
+ */
+#ifdef CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+static void IRAM_ATTR stepperTaskAlarm(void *arg) {
+    StepperTask *task = reinterpret_cast<StepperTask *>(arg);
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR((TaskHandle_t)task->handle, &woken);
+    if (woken) esp_timer_isr_dispatch_need_yield();
+}
+#define STEPPER_ALARM_DISPATCH ESP_TIMER_ISR
+#else
+static void stepperTaskAlarm(void *arg) {
+    StepperTask *task = reinterpret_cast<StepperTask *>(arg);
+    xTaskNotifyGive((TaskHandle_t)task->handle);
+}
+#define STEPPER_ALARM_DISPATCH ESP_TIMER_TASK
+#endif
+
+void stepperStartTask(StepperTask *task, const StepperTaskConfig &config) {
+    esp_timer_create_args_t args = {};
+    args.callback = stepperTaskAlarm;
+    args.arg = task;
+    args.dispatch_method = STEPPER_ALARM_DISPATCH;
+    args.name = "stepperAlarm";
+    esp_timer_create(&args, (esp_timer_handle_t *)&task->alarm);
+
+    const char *name = config.name != nullptr ? config.name : task->name;
+    BaseType_t core = config.core < 0 ? tskNO_AFFINITY : config.core;
+    if (config.stack != nullptr && config.control != nullptr) {
+        static_assert(sizeof(StaticTask_t) <= STEPPER_TASK_CONTROL_SIZE, "STEPPER_TASK_CONTROL_SIZE too small");
+        task->handle = xTaskCreateStaticPinnedToCore(
+            stepperTaskLoop, name, config.stack_size, task, config.priority,
+            (StackType_t *)config.stack, (StaticTask_t *)config.control, core);
+        return;
+    }
+    xTaskCreatePinnedToCore(
+        stepperTaskLoop,    // Task function.
+        name,               // name of task.
+        config.stack_size,  // Stack size of task (bytes)
+        task,               // parameter of the task
+        config.priority,    // priority of the task
+        (TaskHandle_t *)&task->handle,  // Task handle to keep track of created task
+        core);              // pin task to a core
+}
+
+void stepperWakeTask(StepperTask *task) {
+    if (task->handle == nullptr) return;
+    xTaskNotifyGive((TaskHandle_t)task->handle);
+}
+
+void stepperYield() {}
+
+/*
+ * Signal backed by one bit of a FreeRTOS event group: setting the bit
+ * wakes every task waiting for it.
+ */
+#define STEPPER_SIGNAL_BIT 1
+
+StepperSignal::StepperSignal() { this->handle = xEventGroupCreate(); }
+
+StepperSignal::~StepperSignal() { vEventGroupDelete((EventGroupHandle_t)this->handle); }
+
+void StepperSignal::clear() { xEventGroupClearBits((EventGroupHandle_t)this->handle, STEPPER_SIGNAL_BIT); }
+
+void StepperSignal::notify() { xEventGroupSetBits((EventGroupHandle_t)this->handle, STEPPER_SIGNAL_BIT); }
+
+bool StepperSignal::wait(unsigned long timeout) {
+    TickType_t ticks = portMAX_DELAY;
+    if (timeout != STEPPER_WAIT_FOREVER) {
+        ticks = pdMS_TO_TICKS((timeout + 999) / 1000);
+    }
+    EventBits_t bits = xEventGroupWaitBits((EventGroupHandle_t)this->handle, STEPPER_SIGNAL_BIT,
+                                           pdFALSE, pdTRUE, ticks);
+    return bits & STEPPER_SIGNAL_BIT;
+}
+
+/*
+ * One shot timer backed by the ESP32 high resolution timer (esp_timer).
+ * The callback plans and does the step (float ramps, arrival signal and
+ * callback, SPI outputs), which cannot run in an interrupt: it is
+ * dispatched by the esp_timer task and a step is late by the latency of
+ * that task, see the timerJitter benchmark.
+ */
+BoardStepperTimer::BoardStepperTimer() {
+    esp_timer_create_args_t args = {};
+    args.callback = BoardStepperTimer::fire;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "stepperTimer";
+
+    esp_timer_handle_t timer = nullptr;
+    esp_timer_create(&args, &timer);
+    this->handle = timer;
+}
+
+BoardStepperTimer::~BoardStepperTimer() {
+    esp_timer_stop((esp_timer_handle_t)this->handle);
+    esp_timer_delete((esp_timer_handle_t)this->handle);
+}
+
+unsigned long BoardStepperTimer::micros() {
+    return (unsigned long)esp_timer_get_time();
+}
+
+void BoardStepperTimer::attach(Callback callback, void *arg) {
+    this->callback = callback;
+    this->arg = arg;
+}
+
+void BoardStepperTimer::armAt(unsigned long date) {
+    long wait = (long)(date - this->micros());
+    if (wait < 1) {
+        wait = 1;
+    }
+
+    // esp_timer_start_once() fails on a running timer.
+    esp_timer_stop((esp_timer_handle_t)this->handle);
+    esp_timer_start_once((esp_timer_handle_t)this->handle, wait);
+}
+
+void BoardStepperTimer::disarm() {
+    esp_timer_stop((esp_timer_handle_t)this->handle);
+}
+
+void BoardStepperTimer::fire(void *arg) {
+    BoardStepperTimer *timer = reinterpret_cast<BoardStepperTimer *>(arg);
+    if (timer->callback != nullptr) {
+        timer->callback(timer->arg);
+    }
+}
+
+/*
+ * Pulse generator backed by an RMT channel with 1 us ticks: the intervals
+ * of a chunk are converted to RMT items (a low wait then a high pulse) when
+ * it is queued, the end of transmission interrupt starts the queued chunk
+ * and notifies the task. A channel uses the memory of the next one.
+ */
+#define PULSE_ITEMS 128         // RMT items of a chunk, 2 memory blocks
+#define PULSE_WIDTH 3           // STEP high time (us)
+#define PULSE_MAX_DURATION 32767  // Longest half of an RMT item (ticks)
+
+struct Esp32PulseGenerator {
+    rmt_channel_t channel;
+    gpio_num_t dir_pin;
+    StepperTask *task = nullptr;
+    uint32_t intervals[2][STEPPER_PULSE_CHUNK];
+    rmt_item32_t items[2][PULSE_ITEMS];
+    int item_counts[2];
+    int directions[2];
+    volatile int playing = -1;  // Chunk playing, -1 for none
+    volatile int queued = -1;   // Chunk waiting behind it
+    int fill = 0;               // Chunk given by nextChunk()
+};
+
+// Channels able to transmit, the first ones of the RMT: a generator takes two
+#ifdef SOC_RMT_TX_CANDIDATES_PER_GROUP
+#define PULSE_TX_CHANNELS SOC_RMT_TX_CANDIDATES_PER_GROUP
+#else
+#define PULSE_TX_CHANNELS RMT_CHANNEL_MAX
+#endif
+
+static Esp32PulseGenerator *pulseGenerators[RMT_CHANNEL_MAX];
+static portMUX_TYPE pulseLock = portMUX_INITIALIZER_UNLOCKED;
+
+static rmt_item32_t pulseItem(uint32_t duration0, int level0, uint32_t duration1, int level1) {
+    rmt_item32_t item;
+    item.duration0 = duration0;
+    item.level0 = level0;
+    item.duration1 = duration1;
+    item.level1 = level1;
+    return item;
+}
+
+/*
+ * Convert the intervals to RMT items ended by a 0 duration item.
+ * Return the number of items.
+ */
+static int pulseItems(const uint32_t *intervals, int count, rmt_item32_t *items) {
+    int n = 0;
+    for (int i = 0; i < count && n < PULSE_ITEMS - 1; i++) {
+        uint32_t wait = intervals[i] > PULSE_WIDTH ? intervals[i] - PULSE_WIDTH : 1;
+        while (wait > PULSE_MAX_DURATION && n < PULSE_ITEMS - 2) {  // Long waits: low only items
+            uint32_t low = wait - PULSE_MAX_DURATION;
+            if (low > 2 * PULSE_MAX_DURATION) low = 2 * PULSE_MAX_DURATION;
+            if (low < 2) low = 2;
+            items[n++] = pulseItem(low - low / 2, 0, low / 2, 0);
+            wait -= low;
+        }
+        items[n++] = pulseItem(wait, 0, PULSE_WIDTH, 1);
+    }
+    items[n++] = pulseItem(0, 0, 0, 0);
+    return n;
+}
+
+static void IRAM_ATTR pulsePlay(Esp32PulseGenerator *generator, int chunk) {
+    generator->playing = chunk;
+    gpio_set_level(generator->dir_pin, generator->directions[chunk] > 0);
+    rmt_fill_tx_items(generator->channel, generator->items[chunk], generator->item_counts[chunk], 0);
+    rmt_tx_start(generator->channel, true);
+}
+
+static void IRAM_ATTR pulseDone(rmt_channel_t channel, void *arg) {
+    Esp32PulseGenerator *generator = pulseGenerators[channel];
+    if (generator == nullptr) return;
+
+    portENTER_CRITICAL_ISR(&pulseLock);
+    generator->playing = -1;
+    if (generator->queued >= 0) {
+        pulsePlay(generator, generator->queued);
+        generator->queued = -1;
+    }
+    portEXIT_CRITICAL_ISR(&pulseLock);
+
+    if (generator->task != nullptr && generator->task->handle != nullptr) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR((TaskHandle_t)generator->task->handle, &woken);
+        if (woken) portYIELD_FROM_ISR();
+    }
+}
+
+BoardPulseGenerator::BoardPulseGenerator(int step_pin, int dir_pin) {
+    this->step_pin = step_pin;
+    this->dir_pin = dir_pin;
+}
+
+BoardPulseGenerator::~BoardPulseGenerator() {
+    Esp32PulseGenerator *generator = reinterpret_cast<Esp32PulseGenerator *>(this->handle);
+    if (generator == nullptr) return;
+    pulseGenerators[generator->channel] = nullptr;
+    rmt_driver_uninstall(generator->channel);
+    delete generator;
+}
+
+bool BoardPulseGenerator::begin() {
+    if (this->handle != nullptr) return true;
+
+    int channel = 0;  // First free pair of TX channels
+    while (channel + 1 < PULSE_TX_CHANNELS && pulseGenerators[channel] != nullptr) channel += 2;
+    if (channel + 1 >= PULSE_TX_CHANNELS) return false;
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)this->step_pin, (rmt_channel_t)channel);
+    config.clk_div = 80;  // 1 us ticks
+    config.mem_block_num = 2;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install((rmt_channel_t)channel, 0, 0) != ESP_OK) {
+        return false;
+    }
+
+    static bool callbackRegistered = false;  // One callback for every channel
+    if (!callbackRegistered) {
+        rmt_register_tx_end_callback(pulseDone, nullptr);
+        callbackRegistered = true;
+    }
+
+    pinMode(this->dir_pin, OUTPUT);
+    Esp32PulseGenerator *generator = new Esp32PulseGenerator();
+    generator->channel = (rmt_channel_t)channel;
+    generator->dir_pin = (gpio_num_t)this->dir_pin;
+    pulseGenerators[channel] = generator;
+    this->handle = generator;
+    return true;
+}
+
+void BoardPulseGenerator::attach(StepperTask *task) {
+    Esp32PulseGenerator *generator = reinterpret_cast<Esp32PulseGenerator *>(this->handle);
+    if (generator != nullptr) generator->task = task;  // Else begin() failed: no pulse is ever queued
+}
+
+uint32_t *BoardPulseGenerator::nextChunk() {
+    Esp32PulseGenerator *generator = reinterpret_cast<Esp32PulseGenerator *>(this->handle);
+    if (generator == nullptr || this->pending() == 2) return nullptr;
+    return generator->intervals[generator->fill];
+}
+
+void BoardPulseGenerator::queue(int count, int direction) {
+    Esp32PulseGenerator *generator = reinterpret_cast<Esp32PulseGenerator *>(this->handle);
+    int chunk = generator->fill;
+    generator->item_counts[chunk] = pulseItems(generator->intervals[chunk], count, generator->items[chunk]);
+    generator->directions[chunk] = direction;
+    generator->fill ^= 1;
+
+    portENTER_CRITICAL(&pulseLock);
+    if (generator->playing < 0) {
+        pulsePlay(generator, chunk);
+    } else {
+        generator->queued = chunk;
+    }
+    portEXIT_CRITICAL(&pulseLock);
+}
+
+int BoardPulseGenerator::pending() {
+    Esp32PulseGenerator *generator = reinterpret_cast<Esp32PulseGenerator *>(this->handle);
+    if (generator == nullptr) return 0;
+    return (generator->playing >= 0) + (generator->queued >= 0);
+}
+
+/*
+ * Shift register chain on SPI2. The frame is sent by a polling transaction
+ * (no interrupt, no task switch: a few us for a few bytes) from a DMA
+ * capable buffer, the CS line is the LATCH: its rising edge at the end of
+ * the transaction latches the frame. A mutex serializes the motors
+ * stepped by different tasks.
+ */
+struct Esp32ShiftRegister {
+    spi_device_handle_t device;
+    SemaphoreHandle_t lock;
+    uint8_t *bytes;  // Frame as shifted out, DMA capable
+};
+
+BoardShiftRegister::BoardShiftRegister(int registers, int data_pin, int clock_pin, int latch_pin,
+                                       uint32_t frequency) {
+    this->registers = registers < 1 ? 1 : registers > 8 ? 8 : registers;
+    this->data_pin = data_pin;
+    this->clock_pin = clock_pin;
+    this->latch_pin = latch_pin;
+    this->frequency = frequency;
+}
+
+BoardShiftRegister::~BoardShiftRegister() {
+    Esp32ShiftRegister *chain = reinterpret_cast<Esp32ShiftRegister *>(this->handle);
+    if (chain == nullptr) return;
+    spi_bus_remove_device(chain->device);
+    spi_bus_free(SPI2_HOST);
+    vSemaphoreDelete(chain->lock);
+    heap_caps_free(chain->bytes);
+    delete chain;
+}
+
+bool BoardShiftRegister::begin() {
+    if (this->handle != nullptr) return true;
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = this->data_pin;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = this->clock_pin;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = 8;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+    if (spi_bus_initialize(SPI2_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) return false;
+#else
+    if (spi_bus_initialize(SPI2_HOST, &bus, 1) != ESP_OK) return false;
+#endif
+
+    spi_device_interface_config_t device = {};
+    device.mode = 0;
+    device.clock_speed_hz = this->frequency;
+    device.spics_io_num = this->latch_pin;
+    device.queue_size = 1;
+    Esp32ShiftRegister *chain = new Esp32ShiftRegister();
+    chain->bytes = reinterpret_cast<uint8_t *>(heap_caps_malloc(8, MALLOC_CAP_DMA));
+    chain->lock = xSemaphoreCreateMutex();
+    if (chain->bytes == nullptr || chain->lock == nullptr ||
+        spi_bus_add_device(SPI2_HOST, &device, &chain->device) != ESP_OK) {
+        if (chain->lock != nullptr) vSemaphoreDelete(chain->lock);
+        heap_caps_free(chain->bytes);
+        delete chain;
+        spi_bus_free(SPI2_HOST);
+        return false;
+    }
+    this->handle = chain;
+
+    this->send();  // The outputs written before begin(), all low by default
+    return true;
+}
+
+void BoardShiftRegister::write(StepperPinMask set, StepperPinMask clear) {
+    Esp32ShiftRegister *chain = reinterpret_cast<Esp32ShiftRegister *>(this->handle);
+    if (chain == nullptr) {  // Sent by begin()
+        this->bits = (this->bits & ~clear) | set;
+        return;
+    }
+
+    xSemaphoreTake(chain->lock, portMAX_DELAY);
+    StepperPinMask bits = (this->bits & ~clear) | set;
+    if (bits != this->bits) {
+        this->bits = bits;
+        this->send();
+    }
+    xSemaphoreGive(chain->lock);
+}
+
+void BoardShiftRegister::send() {
+    Esp32ShiftRegister *chain = reinterpret_cast<Esp32ShiftRegister *>(this->handle);
+    for (int i = 0; i < this->registers; i++) {
+        chain->bytes[i] = this->bits >> (8 * (this->registers - 1 - i));
+    }
+    spi_transaction_t transaction = {};
+    transaction.length = 8 * this->registers;  // bits
+    transaction.tx_buffer = chain->bytes;
+    spi_device_polling_transmit(chain->device, &transaction);
+    this->transfer_count++;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * SmoothStepperQueue.h - Bounded lock-free single producer / single consumer
+ * queue used between the application core and the step loop.
+ *
+ * One side only pushes, the other only pops: no lock, no blocking.
+ * Size must be a power of 2.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperQueue_h
+#define SmoothStepperQueue_h
+
+#include <stdint.h>
+
+#include <atomic>
+
+template <typename T, uint32_t Size>
+class StepperQueue {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+   public:
+    // Producer: add an item, return false when the queue is full
+    bool push(const T &item) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) == Size) return false;
+
+        this->items[head & (Size - 1)] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: take the oldest item, return false when the queue is empty
+    bool pop(T *item) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == this->head.load(std::memory_order_acquire)) return false;
+
+        *item = this->items[tail & (Size - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: look at the item at position index (0 is the oldest) without taking it
+    bool peek(uint32_t index, T *item) const {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (index >= this->head.load(std::memory_order_acquire) - tail) return false;
+
+        *item = this->items[(tail + index) & (Size - 1)];
+        return true;
+    }
+
+    // Consumer: drop every item
+    void clear() {
+        this->tail.store(this->head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    // Either side
+    uint32_t size() const {
+        return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+    }
+
+    // Either side
+    bool empty() const {
+        return this->head.load(std::memory_order_acquire) == this->tail.load(std::memory_order_acquire);
+    }
+
+   private:
+    T items[Size];
+    std::atomic<uint32_t> head{0};  // Next item to write
+    std::atomic<uint32_t> tail{0};  // Next item to read
+};
+
+#endif
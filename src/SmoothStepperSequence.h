@@ -0,0 +1,70 @@
+/*
+ * SmoothStepperSequence.h - Phase sequences of the SmoothStepper library.
+ *
+ * The pin levels of each step of a sequence, motor_pin_1 is the leftmost
+ * bit (see the tables in SmoothStepper.h). The tables are constexpr so
+ * that SmoothStepperMotor<PinCount, Sequence> knows them at compile time.
+ * microsteps is the number of steps of the sequence per full step of the
+ * motor. Any struct with the same members is a sequence.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperSequence_h
+#define SmoothStepperSequence_h
+
+#include <stdint.h>
+
+struct TwoWireSequence {
+    static constexpr int pins = 2;
+    static constexpr int length = 4;
+    static constexpr int microsteps = 1;
+    static constexpr uint8_t phases[length] = {0b01, 0b11, 0b10, 0b00};
+};
+
+struct FourWireSequence {
+    static constexpr int pins = 4;
+    static constexpr int length = 4;
+    static constexpr int microsteps = 1;
+    static constexpr uint8_t phases[length] = {0b1010, 0b0110, 0b0101, 0b1001};
+};
+
+// Full steps of FourWireSequence with a one coil step in between
+struct FourWireHalfSequence {
+    static constexpr int pins = 4;
+    static constexpr int length = 8;
+    static constexpr int microsteps = 2;
+    static constexpr uint8_t phases[length] = {0b1010, 0b0010, 0b0110, 0b0100,
+                                               0b0101, 0b0001, 0b1001, 0b1000};
+};
+
+struct FiveWireSequence {
+    static constexpr int pins = 5;
+    static constexpr int length = 10;
+    static constexpr int microsteps = 1;
+    static constexpr uint8_t phases[length] = {0b01101, 0b01001, 0b01011, 0b01010, 0b11010,
+                                               0b10010, 0b10110, 0b10100, 0b10101, 0b00101};
+};
+
+// Default sequence of a number of wires
+template <int PinCount>
+struct StepperSequenceFor;
+
+template <>
+struct StepperSequenceFor<2> {
+    typedef TwoWireSequence type;
+};
+
+template <>
+struct StepperSequenceFor<4> {
+    typedef FourWireSequence type;
+};
+
+template <>
+struct StepperSequenceFor<5> {
+    typedef FiveWireSequence type;
+};
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * SmoothStepperTiming.h - Step timing instrumentation of the SmoothStepper library.
+ *
+ * Compiled in only with SMOOTHSTEPPER_TIMING set to 1 (build flag
+ * -DSMOOTHSTEPPER_TIMING=1), otherwise it costs nothing.
+ *
+ * The step loop records the planned interval, the actual interval and the
+ * lateness of each step in a fixed size single producer / single consumer
+ * ring buffer, which the other core can read while the motor runs.
+ * Steps recorded while the buffer is full are dropped and counted.
+ * The counters are published behind a sequence counter like the state of
+ * the motor (SmoothStepper::snapshot()): summary() returns them all from
+ * the same step, without tearing the 64 bit sums on a 32 bit board.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperTiming_h
+#define SmoothStepperTiming_h
+
+#ifndef SMOOTHSTEPPER_TIMING
+#define SMOOTHSTEPPER_TIMING 0
+#endif
+
+#ifndef SMOOTHSTEPPER_TIMING_SIZE
+#define SMOOTHSTEPPER_TIMING_SIZE 64  // Records in the ring buffer, power of 2
+#endif
+
+#if SMOOTHSTEPPER_TIMING
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "SmoothStepperQueue.h"
+
+struct StepTiming {
+    uint32_t planned;  // Planned interval (us)
+    uint32_t actual;   // Actual interval (us)
+    int32_t lateness;  // Actual - planned date of the step (us)
+};
+
+/*
+ * Running min/max/mean of a value.
+ */
+struct StepTimingStats {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+
+    void add(int32_t value, uint32_t count) volatile {
+        if (count == 0 || value < this->min) this->min = value;
+        if (count == 0 || value > this->max) this->max = value;
+        this->sum += value;
+    }
+};
+
+/*
+ * Counters over all the recorded steps, taken at once.
+ */
+struct StepTimingSummary {
+    uint32_t steps;
+    uint32_t dropped;
+    int32_t minLateness;
+    int32_t maxLateness;
+    int32_t meanLateness;
+    int32_t minInterval;
+    int32_t maxInterval;
+    int32_t meanInterval;
+};
+
+class StepTimingLog {
+   public:
+    // Producer (step loop): add a record
+    void record(uint32_t planned, uint32_t actual, int32_t lateness) {
+        StepTiming timing = {planned, actual, lateness};
+        bool pushed = this->buffer.push(timing);
+
+        uint32_t sequence = this->sequence.load(std::memory_order_relaxed);
+        this->sequence.store(sequence + 1, std::memory_order_relaxed);  // Odd while written
+        std::atomic_thread_fence(std::memory_order_release);
+        this->latenessStats.add(lateness, this->count);
+        this->intervalStats.add(actual, this->count);
+        this->count++;
+        if (!pushed) this->dropped++;
+        this->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Consumer: take the oldest record, return false when there is none
+    bool read(StepTiming *timing) { return this->buffer.pop(timing); }
+
+    // Counters over all the recorded steps, all from the same step
+    StepTimingSummary summary() const {
+        uint32_t count, dropped, before, after;
+        StepTimingStats lateness, interval;
+        do {
+            before = this->sequence.load(std::memory_order_acquire);
+            count = this->count;
+            dropped = this->dropped;
+            lateness.min = this->latenessStats.min;
+            lateness.max = this->latenessStats.max;
+            lateness.sum = this->latenessStats.sum;
+            interval.min = this->intervalStats.min;
+            interval.max = this->intervalStats.max;
+            interval.sum = this->intervalStats.sum;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = this->sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        StepTimingSummary summary;
+        summary.steps = count;
+        summary.dropped = dropped;
+        summary.minLateness = lateness.min;
+        summary.maxLateness = lateness.max;
+        summary.meanLateness = count ? lateness.sum / count : 0;
+        summary.minInterval = interval.min;
+        summary.maxInterval = interval.max;
+        summary.meanInterval = count ? interval.sum / count : 0;
+        return summary;
+    }
+
+    // One counter each, every call takes a new summary(): use summary() for
+    // counters of the same step
+    uint32_t steps() const { return this->summary().steps; }
+    uint32_t droppedSteps() const { return this->summary().dropped; }
+    int32_t minLateness() const { return this->summary().minLateness; }
+    int32_t maxLateness() const { return this->summary().maxLateness; }
+    int32_t meanLateness() const { return this->summary().meanLateness; }
+    int32_t minInterval() const { return this->summary().minInterval; }
+    int32_t maxInterval() const { return this->summary().maxInterval; }
+    int32_t meanInterval() const { return this->summary().meanInterval; }
+
+   private:
+    StepperQueue<StepTiming, SMOOTHSTEPPER_TIMING_SIZE> buffer;
+
+    // counters, written by the step loop only
+    std::atomic<uint32_t> sequence{0};  // Odd while the counters are written
+    volatile uint32_t count = 0;
+    volatile uint32_t dropped = 0;
+    volatile StepTimingStats latenessStats = {0, 0, 0};
+    volatile StepTimingStats intervalStats = {0, 0, 0};
+};
+
+#endif
+
+#endif
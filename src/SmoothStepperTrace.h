@@ -0,0 +1,246 @@
+/*
+ * SmoothStepperTrace.h - Step event trace of the SmoothStepper library.
+ *
+ * A motor given a StepTraceLog with setTrace() records each step, each
+ * change of direction and each change of its planner state as a few bytes
+ * in a byte ring buffer allocated by the application, which can be read
+ * and dumped (serial, file) while the motor runs. Without a trace the
+ * cost is one test per step.
+ *
+ * The interval of a step is stored as its change from the interval of
+ * the previous step, so a step at constant speed takes one byte:
+ *   0sssssss                   step, interval change -64..63 us
+ *   10ssssss ssssssss          step, interval change -8192..8191 us
+ *   11000000                   the next steps go the other way
+ *   11010ppp                   planner state p (SmoothStepper::Planner)
+ *   11100000 + 4 bytes         step, whole interval (us)
+ *   1111dppp + 8 bytes         sync: date (us) and position of the step
+ *                              before the next one, direction d (1 for
+ *                              backward) and planner state p
+ * Multi byte values are little endian. A sync starts the trace and
+ * follows the records dropped while the buffer was full.
+ *
+ * StepTraceDecoder turns the bytes back into steps (extras/tools/traceDecode.cpp).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothStepperTrace_h
+#define SmoothStepperTrace_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define TRACE_STEP_LONG 0x80
+#define TRACE_REVERSE 0xC0
+#define TRACE_PLANNER 0xD0
+#define TRACE_STEP_FULL 0xE0
+#define TRACE_SYNC 0xF0
+
+class StepTraceLog {
+   public:
+    /**
+     * - buffer: bytes of the ring buffer, kept by the application
+     * - size: of the buffer, power of 2
+     * */
+    StepTraceLog(uint8_t *buffer, uint32_t size) : buffer(buffer), mask(size - 1) {}
+
+    // Producer (step loop): a step to position in direction (1 or -1) at now (us)
+    void step(unsigned long now, int8_t direction, long position) {
+        uint32_t interval = now - this->last_date;
+        if (this->unsynced) {
+            if (!this->sync(now, direction, position - direction)) return;
+            interval = 0;
+        }
+
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        uint32_t room = this->mask + 1 - (head - this->tail.load(std::memory_order_acquire));
+        if (room < 6) {  // Largest step record, with a reverse
+            this->drop();
+            return;
+        }
+
+        if (direction != this->direction) {
+            this->put(head++, TRACE_REVERSE);
+            this->direction = direction;
+        }
+        int32_t change = (int32_t)(interval - this->last_interval);
+        if (change >= -64 && change < 64) {
+            this->put(head++, change & 0x7F);
+        } else if (change >= -8192 && change < 8192) {
+            this->put(head++, TRACE_STEP_LONG | ((change >> 8) & 0x3F));
+            this->put(head++, change & 0xFF);
+        } else {
+            this->put(head++, TRACE_STEP_FULL);
+            head = this->put32(head, interval);
+        }
+        this->head.store(head, std::memory_order_release);
+        this->last_date = now;
+        this->last_interval = interval;
+    }
+
+    // Producer (step loop): the planner state of the motor, recorded when it changes
+    void planner(uint8_t state) {
+        if (state == this->state) return;
+        this->state = state;
+        if (this->unsynced) return;  // In the next sync
+
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) > this->mask) {
+            this->drop();
+            return;
+        }
+        this->put(head, TRACE_PLANNER | state);
+        this->head.store(head + 1, std::memory_order_release);
+    }
+
+    // Consumer: take at most length of the oldest bytes, return their number
+    size_t read(uint8_t *data, size_t length) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        uint32_t available = this->head.load(std::memory_order_acquire) - tail;
+        if (length > available) length = available;
+        for (size_t i = 0; i < length; i++) {
+            data[i] = this->buffer[(tail + i) & this->mask];
+        }
+        this->tail.store(tail + length, std::memory_order_release);
+        return length;
+    }
+
+    // Consumer: bytes to read
+    uint32_t available() const {
+        return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_relaxed);
+    }
+
+    // Records dropped while the buffer was full
+    uint32_t dropped() const { return this->dropped_count; }
+
+   private:
+    bool sync(unsigned long date, int8_t direction, long position) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (this->mask + 1 - (head - this->tail.load(std::memory_order_acquire)) < 9 + 6) {
+            this->dropped_count++;  // With room for the step after it
+            return false;
+        }
+
+        this->put(head++, TRACE_SYNC | (direction < 0 ? 0x08 : 0) | (this->state & 0x07));
+        head = this->put32(head, date);
+        head = this->put32(head, position);
+        this->head.store(head, std::memory_order_release);
+        this->direction = direction;
+        this->last_date = date;
+        this->last_interval = 0;
+        this->unsynced = false;
+        return true;
+    }
+
+    void drop() {
+        this->dropped_count++;
+        this->unsynced = true;
+    }
+
+    void put(uint32_t index, uint8_t byte) { this->buffer[index & this->mask] = byte; }
+
+    uint32_t put32(uint32_t index, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            this->put(index++, value >> (8 * i));
+        }
+        return index;
+    }
+
+    uint8_t *buffer;
+    uint32_t mask;
+    std::atomic<uint32_t> head{0};  // Written by the producer
+    std::atomic<uint32_t> tail{0};  // Written by the consumer
+
+    // producer
+    bool unsynced = true;
+    int8_t direction = 1;
+    uint8_t state = 0;
+    unsigned long last_date = 0;  // Of the last step (us)
+    uint32_t last_interval = 0;
+    volatile uint32_t dropped_count = 0;
+};
+
+/*
+ * A step decoded from a trace.
+ */
+struct StepTraceEvent {
+    unsigned long date;  // us
+    long position;       // After the step
+    int8_t direction;
+    uint32_t interval;  // From the previous step (us), 0 for the first one after a sync
+    uint8_t planner;    // SmoothStepper::Planner
+};
+
+class StepTraceDecoder {
+   public:
+    // Add a byte of the trace, return true when it completes a step
+    bool feed(uint8_t byte, StepTraceEvent *event) {
+        this->record[this->length++] = byte;
+        uint8_t first = this->record[0];
+        uint8_t needed = first < TRACE_STEP_LONG ? 1 : first < TRACE_REVERSE ? 2 : first == TRACE_STEP_FULL ? 5 : first >= TRACE_SYNC ? 9 : 1;
+        if (this->length < needed) return false;
+        this->length = 0;
+
+        int32_t change = 0;
+        if (first >= TRACE_SYNC) {
+            this->synced = true;
+            this->direction = (first & 0x08) ? -1 : 1;
+            this->planner = first & 0x07;
+            this->date = this->get32(1);
+            this->position = (int32_t)this->get32(5);
+            this->interval = 0;
+            return false;
+        } else if (first == TRACE_REVERSE) {
+            this->direction = -this->direction;
+            return false;
+        } else if ((first & 0xF8) == TRACE_PLANNER) {
+            this->planner = first & 0x07;
+            return false;
+        } else if (first < TRACE_STEP_LONG) {
+            change = (int32_t)((uint32_t)first << 25) >> 25;  // Sign extended
+        } else if (first < TRACE_REVERSE) {
+            change = (int32_t)((uint32_t)(((first & 0x3F) << 8) | this->record[1]) << 18) >> 18;
+        } else if (first == TRACE_STEP_FULL) {
+            change = (int32_t)(this->get32(1) - this->interval);
+        } else {
+            this->errors++;  // Unknown record
+            return false;
+        }
+        if (!this->synced) return false;
+
+        this->interval += change;
+        this->date += this->interval;
+        this->position += this->direction;
+        event->date = this->date;
+        event->position = this->position;
+        event->direction = this->direction;
+        event->interval = this->interval;
+        event->planner = this->planner;
+        return true;
+    }
+
+    // Unknown records skipped
+    uint32_t errors = 0;
+
+   private:
+    uint32_t get32(int index) {
+        return (uint32_t)this->record[index] | (uint32_t)this->record[index + 1] << 8 |
+               (uint32_t)this->record[index + 2] << 16 | (uint32_t)this->record[index + 3] << 24;
+    }
+
+    uint8_t record[9];
+    uint8_t length = 0;
+    bool synced = false;
+    int8_t direction = 1;
+    uint8_t planner = 0;
+    unsigned long date = 0;
+    long position = 0;
+    uint32_t interval = 0;
+};
+
+#endif
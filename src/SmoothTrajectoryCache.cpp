@@ -0,0 +1,206 @@
+/*
+ * SmoothTrajectoryCache.cpp - Precomputed moves of the SmoothStepper library.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include "SmoothTrajectoryCache.h"
+
+#include <string.h>
+
+SmoothTrajectoryCache::SmoothTrajectoryCache(size_t budget) {
+    this->budget = budget;
+}
+
+SmoothTrajectoryCache::~SmoothTrajectoryCache() {
+    while (this->count > 0) {
+        this->drop(this->count - 1);
+    }
+}
+
+bool SmoothTrajectoryCache::step(SmoothStepper *stepper, long steps) {
+    if (!stepper->started) {
+        return stepper->step(steps);
+    }
+
+    SmoothTrajectory *trajectory = this->find(stepper, steps);
+    if (trajectory == nullptr) {  // Over the budget
+        return stepper->step(steps);
+    }
+
+    trajectory->users++;
+    SmoothStepper::Command command = {SmoothStepper::PLAY_TRAJECTORY, 0, 0, 0};
+    command.trajectory = trajectory;
+    if (!stepper->sendCommand(command)) {
+        trajectory->users--;
+        return false;
+    }
+    return true;
+}
+
+bool SmoothTrajectoryCache::precompile(SmoothStepper *stepper, long steps) {
+    unsigned long hits = this->hit_count;
+    unsigned long misses = this->miss_count;
+    bool cached = this->find(stepper, steps) != nullptr;
+    this->hit_count = hits;
+    this->miss_count = misses;
+    return cached;
+}
+
+float SmoothTrajectoryCache::hitRate() {
+    unsigned long total = this->hit_count + this->miss_count;
+    return total > 0 ? (float)this->hit_count / total : 0;
+}
+
+/*
+ * Return the compiled move, compiling it when it is not in the cache,
+ * nullptr when it does not fit in the budget.
+ */
+SmoothTrajectory *SmoothTrajectoryCache::find(SmoothStepper *stepper, long steps) {
+    const SmoothStepper::Profile &profile = stepper->profile;
+    for (int entry = 0; entry < this->count; entry++) {
+        SmoothTrajectory *trajectory = this->entries[entry];
+        if (trajectory->steps == steps && trajectory->number_of_steps == stepper->number_of_steps &&
+            trajectory->backend == stepper->rampBackend &&
+            trajectory->profile.minSpeed == profile.minSpeed &&
+            trajectory->profile.maxSpeed == profile.maxSpeed &&
+            trajectory->profile.rampTime == profile.rampTime &&
+            trajectory->profile.jerkTime == profile.jerkTime) {
+            trajectory->last_used = ++this->use_count;
+            this->hit_count++;
+            return trajectory;
+        }
+    }
+
+    this->miss_count++;
+    SmoothTrajectory *trajectory = this->compile(stepper, steps);
+    size_t bytes = sizeof(SmoothTrajectory) + trajectory->length * sizeof(int16_t);
+    if (!this->makeRoom(bytes)) {
+        delete[] trajectory->words;
+        delete trajectory;
+        return nullptr;
+    }
+
+    trajectory->last_used = ++this->use_count;
+    this->entries[this->count++] = trajectory;
+    this->memory_used += bytes;
+    return trajectory;
+}
+
+/*
+ * Run the planner of a motor with the same settings from standstill and
+ * record the interval before each step.
+ */
+SmoothTrajectory *SmoothTrajectoryCache::compile(SmoothStepper *stepper, long steps) {
+    SmoothTrajectory *trajectory = new SmoothTrajectory();
+    trajectory->steps = steps;
+    trajectory->number_of_steps = stepper->number_of_steps;
+    trajectory->backend = stepper->rampBackend;
+    trajectory->profile = stepper->profile;
+    trajectory->direction = steps >= 0 ? 1 : -1;
+
+    // Not started: the settings are applied at once.
+    SmoothStepper *planner = new SmoothStepper(stepper->number_of_steps);
+    planner->clock = &planner->planning;
+    planner->setRampBackend(stepper->rampBackend);
+    const SmoothStepper::Profile &profile = stepper->profile;
+    if (profile.rampTime > 0) {
+        planner->accelerationEnable(profile.minSpeed, profile.maxSpeed, profile.rampTime);
+    } else {
+        planner->accelerationDisable(profile.minSpeed);
+    }
+    planner->setJerk(profile.jerkTime);
+    planner->step(steps);
+    planner->calculStrategy();
+    planner->last_step_time = 0 - planner->step_interval;  // The first step is now
+
+    uint32_t capacity = 64;
+    int16_t *words = new int16_t[capacity];
+    uint32_t length = 0;
+    uint32_t repeat = 0;         // Word of the TRAJECTORY_REPEAT being counted
+    unsigned long interval = 0;  // Of the previous step
+    int direction = trajectory->direction;
+    while (planner->isMoving()) {
+        unsigned long previous = planner->last_step_time;
+        long position = planner->current_step;
+        unsigned long date = planner->nextStepTime();
+        planner->planning.now = date;
+        if (!planner->poll(date)) break;
+
+        if (length + 4 > capacity) {  // At most 4 words per step
+            int16_t *larger = new int16_t[capacity * 2];
+            memcpy(larger, words, length * sizeof(int16_t));
+            delete[] words;
+            words = larger;
+            capacity *= 2;
+        }
+
+        int stepDirection = planner->current_step > position ? 1 : -1;
+        unsigned long stepInterval = length == 0 ? 0 : date - previous;
+        long delta = (long)(stepInterval - interval);
+        interval = stepInterval;
+
+        if (delta == 0 && stepDirection == direction && length > 0) {
+            if (repeat > 0 && (uint16_t)words[repeat] < UINT16_MAX) {
+                words[repeat] = (int16_t)((uint16_t)words[repeat] + 1);
+            } else {
+                words[length++] = TRAJECTORY_REPEAT;
+                repeat = length;
+                words[length++] = 1;
+            }
+            continue;
+        }
+        repeat = 0;
+
+        if (stepDirection != direction) {
+            words[length++] = TRAJECTORY_REVERSE;
+            direction = stepDirection;
+        }
+        if (delta > INT16_MAX || delta <= TRAJECTORY_REPEAT) {
+            words[length++] = TRAJECTORY_ESCAPE;
+            words[length++] = (int16_t)(stepInterval >> 16);
+            words[length++] = (int16_t)(stepInterval & 0xFFFF);
+        } else {
+            words[length++] = (int16_t)delta;
+        }
+    }
+    delete planner;
+
+    // Trimmed to its length
+    trajectory->words = new int16_t[length > 0 ? length : 1];
+    memcpy(trajectory->words, words, length * sizeof(int16_t));
+    trajectory->length = length;
+    delete[] words;
+    return trajectory;
+}
+
+/*
+ * Drop the least recently used moves no motor plays until bytes fit.
+ * Return false when they can't.
+ */
+bool SmoothTrajectoryCache::makeRoom(size_t bytes) {
+    while (this->memory_used + bytes > this->budget || this->count == SMOOTHSTEPPER_TRAJECTORY_ENTRIES) {
+        int oldest = -1;
+        for (int entry = 0; entry < this->count; entry++) {
+            SmoothTrajectory *trajectory = this->entries[entry];
+            if (trajectory->users > 0) continue;
+            if (oldest < 0 || trajectory->last_used < this->entries[oldest]->last_used) {
+                oldest = entry;
+            }
+        }
+        if (oldest < 0) return false;
+        this->drop(oldest);
+    }
+    return true;
+}
+
+void SmoothTrajectoryCache::drop(int entry) {
+    SmoothTrajectory *trajectory = this->entries[entry];
+    this->memory_used -= sizeof(SmoothTrajectory) + trajectory->length * sizeof(int16_t);
+    delete[] trajectory->words;
+    delete trajectory;
+
+    this->entries[entry] = this->entries[--this->count];
+}
@@ -0,0 +1,140 @@
+/*
+ * SmoothTrajectoryCache.h - Precomputed moves of the SmoothStepper library.
+ *
+ * A move is compiled once by running the planner of the motor offline,
+ * from standstill, on a planning clock: the interval before each step is
+ * stored as a 16 bit delta from the previous one. Playing it back is a
+ * table walk, no calculStrategy() and no calculateDelay().
+ *
+ * The cache keeps the compiled moves by (distance, speed settings) within
+ * a RAM budget and drops the least recently used ones to make room.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#ifndef SmoothTrajectoryCache_h
+#define SmoothTrajectoryCache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "SmoothStepper.h"
+
+#ifndef SMOOTHSTEPPER_TRAJECTORY_ENTRIES
+#define SMOOTHSTEPPER_TRAJECTORY_ENTRIES 16  // Most moves in a cache
+#endif
+
+/*
+ * Compiled move: one word per step, the delta (us) of its interval from
+ * the previous one. Three reserved words: TRAJECTORY_ESCAPE followed by
+ * the whole interval in two words, TRAJECTORY_REVERSE before a step in the
+ * other direction and TRAJECTORY_REPEAT followed by a number of steps with
+ * the same interval (the constant speed part).
+ */
+#define TRAJECTORY_ESCAPE INT16_MIN
+#define TRAJECTORY_REVERSE (INT16_MIN + 1)
+#define TRAJECTORY_REPEAT (INT16_MIN + 2)
+
+struct SmoothTrajectory {
+    // key
+    long steps;                      // Distance of the move
+    int number_of_steps;             // Of the motor
+    uint8_t backend;                 // SmoothStepper::RampBackend
+    SmoothStepper::Profile profile;  // Speed settings
+
+    int8_t direction;  // Of the first step
+    int16_t *words;
+    uint32_t length;  // Words
+
+    std::atomic<int> users{0};  // Motors playing it, not dropped meanwhile
+    unsigned long last_used = 0;
+
+    // Decode the next step from position (next word) and repeat (steps
+    // left with the same interval): its interval (us), from the previous
+    // one, and its direction. Return false after the last step.
+    bool next(uint32_t *position, uint16_t *repeat, unsigned long *interval, int *direction) const {
+        if (*repeat > 0) {
+            (*repeat)--;
+            return true;
+        }
+        if (*position >= this->length) return false;
+
+        int16_t word = this->words[(*position)++];
+        if (word == TRAJECTORY_REPEAT) {
+            *repeat = (uint16_t)this->words[(*position)++] - 1;
+            return true;
+        }
+        if (word == TRAJECTORY_REVERSE) {
+            *direction = -*direction;
+            word = this->words[(*position)++];
+        }
+        if (word == TRAJECTORY_ESCAPE) {
+            *interval = (unsigned long)(uint16_t)this->words[*position] << 16 |
+                        (uint16_t)this->words[*position + 1];
+            *position += 2;
+        } else {
+            *interval += word;
+        }
+        return true;
+    }
+};
+
+class SmoothTrajectoryCache {
+   public:
+    /**
+     * - budget: RAM (bytes) the compiled moves may use
+     * */
+    explicit SmoothTrajectoryCache(size_t budget);
+    ~SmoothTrajectoryCache();
+
+    /**
+     * Relative move of a started motor, like stepper->step(steps).
+     * Played from the cache when the motor is at standstill and the move
+     * was compiled with the same speed settings, compiled first otherwise
+     * (in the calling task). A move over the budget is not cached.
+     * Return false when the command queue is full.
+     * */
+    bool step(SmoothStepper *stepper, long steps);
+
+    /**
+     * Compile a move with the current speed settings of the motor ahead of
+     * time, so that its first step() is a hit.
+     * Return false when it does not fit in the budget.
+     * */
+    bool precompile(SmoothStepper *stepper, long steps);
+
+    // Moves found in the cache / compiled by step()
+    unsigned long hits() { return this->hit_count; }
+    unsigned long misses() { return this->miss_count; }
+
+    // hits / (hits + misses), 0 before the first step()
+    float hitRate();
+
+    // RAM (bytes) used by the compiled moves
+    size_t memoryUsed() { return this->memory_used; }
+
+    // Number of compiled moves
+    int size() { return this->count; }
+
+   private:
+    friend class SmoothStepperBenchmark;
+
+    SmoothTrajectory *find(SmoothStepper *stepper, long steps);
+    SmoothTrajectory *compile(SmoothStepper *stepper, long steps);
+    bool makeRoom(size_t bytes);
+    void drop(int entry);
+
+    SmoothTrajectory *entries[SMOOTHSTEPPER_TRAJECTORY_ENTRIES];
+    int count = 0;
+    size_t budget;
+    size_t memory_used = 0;
+    unsigned long use_count = 0;  // Date of the last use, for the LRU
+    unsigned long hit_count = 0;
+    unsigned long miss_count = 0;
+};
+
+#endif